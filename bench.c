@@ -0,0 +1,761 @@
+#define XJSON_H_IMPLEMENTATION
+#include "xjson.h"
+#include <stdio.h>
+#include <time.h>
+
+/*
+    Read/write throughput on generated corpora and per-primitive microbenchmarks.
+
+    The corpora are generated with a fixed seed and are modelled after the usual json benchmark files: twitter.json
+    (mostly strings, some of them non-ascii), canada.json (mostly doubles) and citm_catalog.json (mostly integers,
+    objects keyed by ids). Every document is written and read with the same process function.
+
+    Results are printed as one json object per line:
+    {"bench":"twitter","format":"compact","op":"read","bytes":..,"values":..,"mb_per_s":..,"docs_per_s":..,"ns_per_value":..}
+
+    Usage: xjson_bench [milliseconds per benchmark, default 500] [filter, only benchmarks whose name contains it]
+*/
+
+//----------------------------------------------------------------------------------
+// Helpers
+//----------------------------------------------------------------------------------
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+uint64_t rng(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+uint32_t rng_range(uint32_t min, uint32_t max)
+{
+    return min + (uint32_t)(rng() % (max - min + 1));
+}
+
+double rng_double(double min, double max)
+{
+    return min + (max - min) * ((rng() >> 11) * (1.0 / 9007199254740992.0));
+}
+
+static const char* words[] = {
+    "the", "json", "parser", "fast", "benchmark", "cafe\xCC\x81", "\xE6\x97\xA5\xE6\x9C\xAC", "stream", "release",
+    "\xF0\x9F\x9A\x80", "quote\"d", "line\nbreak", "tab\tbed", "path\\to", "numbers", "ni\xC3\xB1o", "encode", "decode"
+};
+
+/* Joins random words, the strings are never freed */
+const char* random_text(uint32_t min_words, uint32_t max_words)
+{
+    char buffer[1024];
+    size_t len = 0;
+    uint32_t count = rng_range(min_words, max_words);
+    for(uint32_t i=0; i<count; i++)
+    {
+        const char* word = words[rng() % (sizeof(words) / sizeof(words[0]))];
+        if(i > 0) buffer[len++] = ' ';
+        size_t word_len = strlen(word);
+        memcpy(buffer + len, word, word_len);
+        len += word_len;
+    }
+    return xjson_malloc_string(buffer, len, NULL);
+}
+
+const char* random_id_string(uint64_t id)
+{
+    char buffer[24];
+    int len = sprintf(buffer, "%" PRIu64, id);
+    return xjson_malloc_string(buffer, len, NULL);
+}
+
+double now_seconds(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    // Without POSIX clocks (e.g. strict -std=c99 when system headers come first), fall back to processor time
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* Number of values (numbers, strings, bools and nulls, but not keys) in compact json */
+size_t count_values(const char* str, size_t len)
+{
+    size_t count = 0;
+    const char* end = str + len;
+    for(const char* ptr = str; ptr < end; ptr++)
+    {
+        if(*ptr == '\"')
+        {
+            for(ptr++; ptr < end && *ptr != '\"'; ptr++)
+            {
+                if(*ptr == '\\') ptr++;
+            }
+            if(ptr + 1 >= end || ptr[1] != ':') count++;
+        }
+        else if(*ptr == '-' || (*ptr >= '0' && *ptr <= '9'))
+        {
+            count++;
+            while(ptr + 1 < end && strchr("0123456789+-.eE", ptr[1]) != NULL) ptr++;
+        }
+        else if(*ptr == 't' || *ptr == 'f' || *ptr == 'n')
+        {
+            count++;
+            while(ptr + 1 < end && ptr[1] >= 'a' && ptr[1] <= 'z') ptr++;
+        }
+    }
+    return count;
+}
+
+//----------------------------------------------------------------------------------
+// twitter.json
+//----------------------------------------------------------------------------------
+typedef struct tweet_user {
+    uint64_t id;
+    const char* name;
+    const char* screen_name;
+    const char* description;
+    uint32_t followers_count;
+    uint32_t friends_count;
+    bool verified;
+} tweet_user;
+
+typedef struct hashtag {
+    const char* text;
+    uint32_t indices[2];
+} hashtag;
+
+typedef struct tweet {
+    uint64_t id;
+    const char* id_str;
+    const char* text;
+    tweet_user user;
+    hashtag hashtags[4];
+    size_t hashtag_count;
+    uint32_t retweet_count;
+    uint32_t favorite_count;
+    bool favorited;
+    bool retweeted;
+} tweet;
+
+typedef struct twitter {
+    tweet* statuses;
+    size_t count;
+    double completed_in;
+    uint64_t max_id;
+} twitter;
+
+void generate_twitter(twitter* doc, size_t count)
+{
+    doc->statuses = calloc(count, sizeof(tweet));
+    doc->count = count;
+    doc->completed_in = 0.087;
+    doc->max_id = 0;
+    for(size_t i=0; i<count; i++)
+    {
+        tweet* t = &doc->statuses[i];
+        t->id = 505874924095815681ull + rng() % 1000000;
+        t->id_str = random_id_string(t->id);
+        t->text = random_text(5, 20);
+        t->user.id = rng() % 3000000000ull;
+        t->user.name = random_text(1, 2);
+        t->user.screen_name = random_text(1, 1);
+        t->user.description = random_text(0, 15);
+        t->user.followers_count = rng_range(0, 100000);
+        t->user.friends_count = rng_range(0, 5000);
+        t->user.verified = rng() % 10 == 0;
+        t->hashtag_count = rng_range(0, 4);
+        for(size_t j=0; j<t->hashtag_count; j++)
+        {
+            t->hashtags[j].text = random_text(1, 1);
+            t->hashtags[j].indices[0] = rng_range(0, 100);
+            t->hashtags[j].indices[1] = t->hashtags[j].indices[0] + rng_range(1, 20);
+        }
+        t->retweet_count = rng_range(0, 500);
+        t->favorite_count = rng_range(0, 500);
+        if(t->id > doc->max_id) doc->max_id = t->id;
+    }
+}
+
+void process_tweet(xjson* json, tweet* t)
+{
+    xjson_object_begin(json, NULL);
+    xjson_u64(json, "id", &t->id);
+    xjson_string(json, "id_str", &t->id_str);
+    xjson_string(json, "text", &t->text);
+
+    xjson_object_begin(json, "user");
+    xjson_u64(json, "id", &t->user.id);
+    xjson_string(json, "name", &t->user.name);
+    xjson_string(json, "screen_name", &t->user.screen_name);
+    xjson_string(json, "description", &t->user.description);
+    xjson_u32(json, "followers_count", &t->user.followers_count);
+    xjson_u32(json, "friends_count", &t->user.friends_count);
+    xjson_bool(json, "verified", &t->user.verified);
+    xjson_object_end(json);
+
+    xjson_object_begin(json, "entities");
+    xjson_array_begin(json, "hashtags");
+    size_t count = 0;
+    for(; !xjson_array_reached_end(json, (int)count, (int)t->hashtag_count) && count < 4; count++)
+    {
+        xjson_object_begin(json, NULL);
+        xjson_string(json, "text", &t->hashtags[count].text);
+        xjson_u32_array(json, "indices", t->hashtags[count].indices, 2, NULL);
+        xjson_object_end(json);
+    }
+    t->hashtag_count = count;
+    xjson_array_end(json);
+    xjson_object_end(json);
+
+    xjson_u32(json, "retweet_count", &t->retweet_count);
+    xjson_u32(json, "favorite_count", &t->favorite_count);
+    xjson_bool(json, "favorited", &t->favorited);
+    xjson_bool(json, "retweeted", &t->retweeted);
+    xjson_object_end(json);
+}
+
+void process_twitter(xjson* json, void* data)
+{
+    twitter* doc = (twitter*)data;
+    xjson_object_begin(json, NULL);
+
+    xjson_array_begin(json, "statuses");
+    for(size_t i=0; !xjson_array_reached_end(json, (int)i, (int)doc->count) && i < doc->count; i++)
+    {
+        process_tweet(json, &doc->statuses[i]);
+    }
+    xjson_array_end(json);
+
+    xjson_object_begin(json, "search_metadata");
+    xjson_double(json, "completed_in", &doc->completed_in);
+    xjson_u64(json, "max_id", &doc->max_id);
+    xjson_object_end(json);
+
+    xjson_object_end(json);
+}
+
+//----------------------------------------------------------------------------------
+// canada.json
+//----------------------------------------------------------------------------------
+typedef struct canada {
+    double (*points)[2];
+    // Number of points of each ring
+    size_t* ring_sizes;
+    size_t ring_count;
+} canada;
+
+void generate_canada(canada* doc, size_t ring_count, size_t point_count)
+{
+    doc->points = calloc(point_count, sizeof(doc->points[0]));
+    doc->ring_sizes = calloc(ring_count, sizeof(size_t));
+    doc->ring_count = ring_count;
+    for(size_t i=0; i<ring_count; i++)
+    {
+        doc->ring_sizes[i] = point_count / ring_count;
+    }
+    doc->ring_sizes[0] += point_count % ring_count;
+
+    // A random walk, like a coastline
+    double x = -65.613616999999977, y = 43.420273000000009;
+    for(size_t i=0; i<point_count; i++)
+    {
+        x += rng_double(-0.01, 0.01);
+        y += rng_double(-0.01, 0.01);
+        doc->points[i][0] = x;
+        doc->points[i][1] = y;
+    }
+}
+
+void process_canada(xjson* json, void* data)
+{
+    canada* doc = (canada*)data;
+    const char* type_collection = "FeatureCollection";
+    const char* type_feature = "Feature";
+    const char* type_polygon = "Polygon";
+    const char* name = "Canada";
+
+    xjson_object_begin(json, NULL);
+    xjson_string(json, "type", &type_collection);
+    xjson_array_begin(json, "features");
+    for(int f=0; !xjson_array_reached_end(json, f, 1); f++)
+    {
+        xjson_object_begin(json, NULL);
+        xjson_string(json, "type", &type_feature);
+        xjson_object_begin(json, "properties");
+        xjson_string(json, "name", &name);
+        xjson_object_end(json);
+
+        xjson_object_begin(json, "geometry");
+        xjson_string(json, "type", &type_polygon);
+        xjson_array_begin(json, "coordinates");
+        size_t point = 0;
+        for(size_t r=0; !xjson_array_reached_end(json, (int)r, (int)doc->ring_count) && r < doc->ring_count; r++)
+        {
+            xjson_array_begin(json, NULL);
+            for(size_t p=0; !xjson_array_reached_end(json, (int)p, (int)doc->ring_sizes[r]) && p < doc->ring_sizes[r]; p++, point++)
+            {
+                xjson_double_array(json, NULL, doc->points[point], 2, NULL);
+            }
+            xjson_array_end(json);
+        }
+        xjson_array_end(json);
+        xjson_object_end(json);
+
+        xjson_object_end(json);
+    }
+    xjson_array_end(json);
+    xjson_object_end(json);
+}
+
+//----------------------------------------------------------------------------------
+// citm_catalog.json
+//----------------------------------------------------------------------------------
+typedef struct citm_event {
+    const char* key;
+    uint64_t id;
+    const char* name;
+    uint64_t sub_topic_ids[8];
+    size_t sub_topic_count;
+    uint64_t topic_ids[4];
+    size_t topic_count;
+} citm_event;
+
+typedef struct citm_price {
+    uint32_t amount;
+    uint64_t audience_sub_category_id;
+    uint64_t seat_category_id;
+} citm_price;
+
+typedef struct citm_performance {
+    uint64_t id;
+    uint64_t event_id;
+    citm_price prices[8];
+    size_t price_count;
+    uint64_t start;
+    const char* venue_code;
+} citm_performance;
+
+typedef struct citm {
+    citm_event* events;
+    size_t event_count;
+    citm_performance* performances;
+    size_t performance_count;
+} citm;
+
+void generate_citm(citm* doc, size_t event_count, size_t performance_count)
+{
+    doc->events = calloc(event_count, sizeof(citm_event));
+    doc->event_count = event_count;
+    for(size_t i=0; i<event_count; i++)
+    {
+        citm_event* e = &doc->events[i];
+        e->id = 138586341 + i * 4;
+        e->key = random_id_string(e->id);
+        e->name = random_text(2, 6);
+        e->sub_topic_count = rng_range(1, 8);
+        for(size_t j=0; j<e->sub_topic_count; j++) e->sub_topic_ids[j] = 337184256 + rng() % 1000;
+        e->topic_count = rng_range(1, 4);
+        for(size_t j=0; j<e->topic_count; j++) e->topic_ids[j] = 107888604 + rng() % 1000;
+    }
+
+    doc->performances = calloc(performance_count, sizeof(citm_performance));
+    doc->performance_count = performance_count;
+    for(size_t i=0; i<performance_count; i++)
+    {
+        citm_performance* p = &doc->performances[i];
+        p->id = 339887544 + i;
+        p->event_id = doc->events[rng() % event_count].id;
+        p->price_count = rng_range(1, 8);
+        for(size_t j=0; j<p->price_count; j++)
+        {
+            p->prices[j].amount = rng_range(5, 300) * 1000;
+            p->prices[j].audience_sub_category_id = 337100890;
+            p->prices[j].seat_category_id = 338937295 + rng() % 100;
+        }
+        p->start = 1372701600000ull + (rng() % 100000) * 3600000ull;
+        p->venue_code = "PLEYEL_PLEYEL";
+    }
+}
+
+void process_citm(xjson* json, void* data)
+{
+    citm* doc = (citm*)data;
+    xjson_object_begin(json, NULL);
+
+    // Events are keyed by their id, like a hash map
+    xjson_object_begin(json, "events");
+    for(size_t i=0; i<doc->event_count; i++)
+    {
+        citm_event* e = &doc->events[i];
+        xjson_key(json, &e->key);
+        xjson_object_begin(json, NULL);
+        xjson_u64(json, "id", &e->id);
+        xjson_string(json, "name", &e->name);
+        xjson_u64_array(json, "subTopicIds", e->sub_topic_ids, 8, &e->sub_topic_count);
+        xjson_u64_array(json, "topicIds", e->topic_ids, 4, &e->topic_count);
+        xjson_object_end(json);
+    }
+    xjson_object_end(json);
+
+    xjson_array_begin(json, "performances");
+    for(size_t i=0; !xjson_array_reached_end(json, (int)i, (int)doc->performance_count) && i < doc->performance_count; i++)
+    {
+        citm_performance* p = &doc->performances[i];
+        xjson_object_begin(json, NULL);
+        xjson_u64(json, "id", &p->id);
+        xjson_u64(json, "eventId", &p->event_id);
+        xjson_array_begin(json, "prices");
+        size_t count = 0;
+        for(; !xjson_array_reached_end(json, (int)count, (int)p->price_count) && count < 8; count++)
+        {
+            xjson_object_begin(json, NULL);
+            xjson_u32(json, "amount", &p->prices[count].amount);
+            xjson_u64(json, "audienceSubCategoryId", &p->prices[count].audience_sub_category_id);
+            xjson_u64(json, "seatCategoryId", &p->prices[count].seat_category_id);
+            xjson_object_end(json);
+        }
+        p->price_count = count;
+        xjson_array_end(json);
+        xjson_u64(json, "start", &p->start);
+        xjson_string(json, "venueCode", &p->venue_code);
+        xjson_object_end(json);
+    }
+    xjson_array_end(json);
+
+    xjson_object_end(json);
+}
+
+//----------------------------------------------------------------------------------
+// Microbenchmarks
+//----------------------------------------------------------------------------------
+typedef struct value_list {
+    size_t count;
+    uint64_t* ints;
+    double* doubles;
+    const char** strings;
+    // Nesting depth of the nested benchmark
+    int depth;
+} value_list;
+
+void process_ints(xjson* json, void* data)
+{
+    value_list* list = (value_list*)data;
+    xjson_object_begin(json, NULL);
+    xjson_array_begin(json, "values");
+    for(size_t i=0; !xjson_array_reached_end(json, (int)i, (int)list->count) && i < list->count; i++)
+    {
+        xjson_u64(json, NULL, &list->ints[i]);
+    }
+    xjson_array_end(json);
+    xjson_object_end(json);
+}
+
+void process_int_array(xjson* json, void* data)
+{
+    value_list* list = (value_list*)data;
+    xjson_object_begin(json, NULL);
+    xjson_u64_array(json, "values", list->ints, list->count, &list->count);
+    xjson_object_end(json);
+}
+
+void process_doubles(xjson* json, void* data)
+{
+    value_list* list = (value_list*)data;
+    xjson_object_begin(json, NULL);
+    xjson_array_begin(json, "values");
+    for(size_t i=0; !xjson_array_reached_end(json, (int)i, (int)list->count) && i < list->count; i++)
+    {
+        xjson_double(json, NULL, &list->doubles[i]);
+    }
+    xjson_array_end(json);
+    xjson_object_end(json);
+}
+
+void process_double_array(xjson* json, void* data)
+{
+    value_list* list = (value_list*)data;
+    xjson_object_begin(json, NULL);
+    xjson_double_array(json, "values", list->doubles, list->count, &list->count);
+    xjson_object_end(json);
+}
+
+void process_strings(xjson* json, void* data)
+{
+    value_list* list = (value_list*)data;
+    xjson_object_begin(json, NULL);
+    xjson_array_begin(json, "values");
+    for(size_t i=0; !xjson_array_reached_end(json, (int)i, (int)list->count) && i < list->count; i++)
+    {
+        xjson_string(json, NULL, &list->strings[i]);
+    }
+    xjson_array_end(json);
+    xjson_object_end(json);
+}
+
+/* Every value is wrapped in depth objects: {"v":{"v":{"v":1}}} */
+void process_nested(xjson* json, void* data)
+{
+    value_list* list = (value_list*)data;
+    xjson_object_begin(json, NULL);
+    xjson_array_begin(json, "values");
+    for(size_t i=0; !xjson_array_reached_end(json, (int)i, (int)list->count) && i < list->count; i++)
+    {
+        xjson_object_begin(json, NULL);
+        for(int d=1; d<list->depth; d++) xjson_object_begin(json, "v");
+        xjson_u64(json, "v", &list->ints[i]);
+        for(int d=1; d<list->depth; d++) xjson_object_end(json);
+        xjson_object_end(json);
+    }
+    xjson_array_end(json);
+    xjson_object_end(json);
+}
+
+/* Event records of 8 keyed values: [{"timestamp":1,"user_id":2,...},...] */
+static const char* event_keys[8] = { "timestamp", "user_id", "session_id", "event_type", "value", "sequence", "flags", "region" };
+static xjson_encoded_key encoded_event_keys[8];
+
+void process_keys(xjson* json, void* data)
+{
+    value_list* list = (value_list*)data;
+    size_t count = list->count / 8;
+    xjson_object_begin(json, NULL);
+    xjson_array_begin(json, "values");
+    for(size_t i=0; !xjson_array_reached_end(json, (int)i, (int)count) && i < count; i++)
+    {
+        xjson_object_begin(json, NULL);
+        for(int k=0; k<8; k++) xjson_u64(json, event_keys[k], &list->ints[i * 8 + k]);
+        xjson_object_end(json);
+    }
+    xjson_array_end(json);
+    xjson_object_end(json);
+}
+
+/* Same as process_keys with keys encoded by xjson_encode_key */
+void process_encoded_keys(xjson* json, void* data)
+{
+    value_list* list = (value_list*)data;
+    size_t count = list->count / 8;
+    xjson_object_begin(json, NULL);
+    xjson_array_begin(json, "values");
+    for(size_t i=0; !xjson_array_reached_end(json, (int)i, (int)count) && i < count; i++)
+    {
+        xjson_object_begin(json, NULL);
+        for(int k=0; k<8; k++)
+        {
+            if(xjson_key_encoded(json, &encoded_event_keys[k])) xjson_u64(json, NULL, &list->ints[i * 8 + k]);
+        }
+        xjson_object_end(json);
+    }
+    xjson_array_end(json);
+    xjson_object_end(json);
+}
+
+value_list* generate_values(size_t count, int depth)
+{
+    value_list* list = calloc(1, sizeof(value_list));
+    list->count = count;
+    list->depth = depth;
+    list->ints = calloc(count, sizeof(uint64_t));
+    list->doubles = calloc(count, sizeof(double));
+    list->strings = calloc(count, sizeof(const char*));
+    for(size_t i=0; i<count; i++)
+    {
+        // Mixed magnitudes, from 1 to 20 digits
+        list->ints[i] = rng() >> (rng() % 64);
+        list->doubles[i] = rng_double(-1.0, 1.0) * (double)(1ull << (rng() % 40));
+        list->strings[i] = random_text(1, 4);
+    }
+    return list;
+}
+
+//----------------------------------------------------------------------------------
+// Runner
+//----------------------------------------------------------------------------------
+typedef enum bench_format {
+    FORMAT_COMPACT,
+    FORMAT_PRETTY,
+    FORMAT_CBOR
+} bench_format;
+
+static const char* format_names[] = { "compact", "pretty", "cbor" };
+
+typedef struct bench {
+    const char* name;
+    void (*process)(xjson* json, void* data);
+    // The generated document, and a copy with the same shape that is read into
+    void* data;
+    void* scratch;
+} bench;
+
+static double min_seconds = 0.5;
+static xjson_arena arena;
+
+bool count_bytes(const char* data, size_t len, void* user)
+{
+    (void)data;
+    *(size_t*)user += len;
+    return true;
+}
+
+void setup_format(xjson* json, bench_format format)
+{
+    if(format == FORMAT_CBOR) xjson_set_format(json, XJSON_FORMAT_CBOR);
+}
+
+void print_result(const bench* b, bench_format format, const char* op, size_t bytes, size_t values, size_t iterations, double best)
+{
+    printf("{\"bench\":\"%s\",\"format\":\"%s\",\"op\":\"%s\",\"bytes\":%zu,\"values\":%zu,\"iterations\":%zu,"
+        "\"mb_per_s\":%.2f,\"docs_per_s\":%.2f,\"ns_per_value\":%.3f}\n",
+        b->name, format_names[format], op, bytes, values, iterations, bytes / best / 1e6, 1.0 / best, best * 1e9 / values);
+    fflush(stdout);
+}
+
+/* Writes and reads the document of b repeatedly and reports the fastest run of each */
+void run_bench(const bench* b, bench_format format)
+{
+    xjson* json = calloc(1, sizeof(xjson));
+
+    // Find out how large the output is first
+    size_t size = 0;
+    xjson_setup_write_sink(json, format == FORMAT_PRETTY, count_bytes, &size);
+    setup_format(json, format);
+    b->process(json, b->data);
+    char* buffer = malloc(size + 1);
+
+    xjson_setup_write(json, format == FORMAT_PRETTY, buffer, size + 1);
+    setup_format(json, format);
+    b->process(json, b->data);
+    if(json->error)
+    {
+        fprintf(stderr, "%s: %s\n", b->name, json->error_message);
+        exit(1);
+    }
+
+    // Values are counted in the compact json of the document
+    size_t values = 0;
+    {
+        size_t compact_size = 0;
+        xjson_setup_write_sink(json, false, count_bytes, &compact_size);
+        b->process(json, b->data);
+        char* compact = malloc(compact_size + 1);
+        xjson_setup_write(json, false, compact, compact_size + 1);
+        b->process(json, b->data);
+        values = count_values(compact, compact_size);
+        free(compact);
+    }
+
+    size_t iterations = 0;
+    double best = 1e30;
+    double start = now_seconds();
+    do
+    {
+        double t = now_seconds();
+        xjson_setup_write(json, format == FORMAT_PRETTY, buffer, size + 1);
+        setup_format(json, format);
+        b->process(json, b->data);
+        t = now_seconds() - t;
+        if(t < best) best = t;
+        iterations++;
+    } while(now_seconds() - start < min_seconds || iterations < 3);
+    print_result(b, format, "write", size, values, iterations, best);
+
+    iterations = 0;
+    best = 1e30;
+    start = now_seconds();
+    do
+    {
+        double t = now_seconds();
+        xjson_set_arena(json, &arena);
+        xjson_setup_read(json, buffer, size);
+        setup_format(json, format);
+        b->process(json, b->scratch);
+        t = now_seconds() - t;
+        if(json->error)
+        {
+            fprintf(stderr, "%s: %s\n", b->name, json->error_message);
+            exit(1);
+        }
+        xjson_arena_reset(&arena);
+        if(t < best) best = t;
+        iterations++;
+    } while(now_seconds() - start < min_seconds || iterations < 3);
+    print_result(b, format, "read", size, values, iterations, best);
+
+    free(buffer);
+    xjson_free(json);
+    free(json);
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc > 1) min_seconds = atof(argv[1]) / 1000.0;
+    const char* filter = argc > 2 ? argv[2] : NULL;
+    xjson_arena_init(&arena, 1024 * 1024);
+
+    // Sizes are about the same as the original files
+    twitter tw, tw_scratch;
+    generate_twitter(&tw, 100);
+    generate_twitter(&tw_scratch, 100);
+    canada ca, ca_scratch;
+    generate_canada(&ca, 480, 111126);
+    generate_canada(&ca_scratch, 480, 111126);
+    citm ci, ci_scratch;
+    generate_citm(&ci, 184, 243);
+    generate_citm(&ci_scratch, 184, 243);
+
+    for(int i=0; i<8; i++) xjson_encode_key(&encoded_event_keys[i], event_keys[i], strlen(event_keys[i]));
+
+    value_list* values = generate_values(100000, 1);
+    value_list* values_scratch = generate_values(100000, 1);
+    value_list* nested[3];
+    value_list* nested_scratch[3];
+    static const int depths[] = { 1, 8, 32 };
+    for(int i=0; i<3; i++)
+    {
+        nested[i] = generate_values(20000, depths[i]);
+        nested_scratch[i] = generate_values(20000, depths[i]);
+    }
+
+    const bench corpora[] = {
+        { "twitter", process_twitter, &tw, &tw_scratch },
+        { "canada", process_canada, &ca, &ca_scratch },
+        { "citm_catalog", process_citm, &ci, &ci_scratch },
+    };
+    const bench primitives[] = {
+        { "int", process_ints, values, values_scratch },
+        { "int_array", process_int_array, values, values_scratch },
+        { "double", process_doubles, values, values_scratch },
+        { "double_array", process_double_array, values, values_scratch },
+        { "string", process_strings, values, values_scratch },
+        { "keys", process_keys, values, values_scratch },
+        { "encoded_keys", process_encoded_keys, values, values_scratch },
+        { "nested_1", process_nested, nested[0], nested_scratch[0] },
+        { "nested_8", process_nested, nested[1], nested_scratch[1] },
+        { "nested_32", process_nested, nested[2], nested_scratch[2] },
+    };
+
+    for(size_t i=0; i<sizeof(corpora) / sizeof(corpora[0]); i++)
+    {
+        if(filter != NULL && strstr(corpora[i].name, filter) == NULL) continue;
+        run_bench(&corpora[i], FORMAT_COMPACT);
+        run_bench(&corpora[i], FORMAT_PRETTY);
+        run_bench(&corpora[i], FORMAT_CBOR);
+    }
+    for(size_t i=0; i<sizeof(primitives) / sizeof(primitives[0]); i++)
+    {
+        if(filter != NULL && strstr(primitives[i].name, filter) == NULL) continue;
+        run_bench(&primitives[i], FORMAT_COMPACT);
+    }
+
+    xjson_arena_free(&arena);
+    return 0;
+}
@@ -17,14 +17,6 @@ typedef struct simple_struct {
     vec2 delta;
 } simple_struct;
 
-char* allocate_string(const char* str, size_t str_len, void* mem_ctx)
-{
-    char* new_str = malloc(str_len + 1); // zero-terminate!
-    memcpy(new_str, str, str_len);
-    new_str[str_len] = '\0';
-    return new_str;
-}
-
 const char* json_sample = "{ \"a\": 20, \"b\": [2.0, 1.0, 3.0], \"c\": \"A test string!\", \"d\": false, \"pos\": { \"x\": 4, \"y\": 10.5 }, \"delta\": { \"x\": 20.3331, \"y\": 8 }}";
 
 int main(int argc, char* argv[])
@@ -42,7 +34,10 @@ int main(int argc, char* argv[])
     xjson* json = malloc(sizeof(xjson));
     memset(json, 0, sizeof(xjson));
     
-    xjson_set_string_allocator(json, allocate_string);
+    // All strings are allocated from the arena and freed together
+    xjson_arena arena;
+    xjson_arena_init(&arena, 4096);
+    xjson_set_arena(json, &arena);
 
     if(read)
     {
@@ -100,4 +95,7 @@ int main(int argc, char* argv[])
     {
         puts(json->error_message);
     }
+
+    xjson_arena_free(&arena);
+    xjson_free(json);
 }
\ No newline at end of file
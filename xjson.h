@@ -38,19 +38,34 @@
 #ifndef XJSON_H
 #define XJSON_H
 
+// The file mapping and timing calls are POSIX, which strict -std=c99/c11 hides unless it's asked for.
+// This only works if xjson.h is included before any system header, otherwise the read-ahead hint is left out
+#if defined(XJSON_H_IMPLEMENTATION) && !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+    #define _DEFAULT_SOURCE
+#endif
+
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stddef.h> // for offsetof in the field macros
 #include <string.h>
 #include <stdio.h>
 #include <malloc.h>
 #include <inttypes.h> // for PRIi64 macros
+#include <float.h>
 
 #include <assert.h>
 #define XJSON_ASSERT(c) assert(c)
 
 #define XJSON_LOG(s) puts(s)
 
+#ifndef XJSON_MALLOC
+#define XJSON_MALLOC(size) malloc(size)
+#endif
+#ifndef XJSON_FREE
+#define XJSON_FREE(ptr) free(ptr)
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -60,31 +75,200 @@ typedef enum xjson_state
 {
     XJSON_STATE_UNITIALIZED = 0,
     XJSON_STATE_READ,
-    XJSON_STATE_WRITE
+    XJSON_STATE_WRITE,
+    // Goes through the write-mode calls, but only counts the bytes they would write
+    XJSON_STATE_MEASURE
 } xjson_state;
 
+typedef enum xjson_format
+{
+    XJSON_FORMAT_JSON = 0,
+    // Binary encoding (RFC 8949), see xjson_set_format
+    XJSON_FORMAT_CBOR
+} xjson_format;
+
+/* An entry of the structural index. Strings, objects and arrays get one each, in document order */
+typedef struct xjson_tape_entry
+{
+    // Offset of the opening quote/bracket
+    uint32_t offset;
+    // Offset of the closing quote/bracket
+    uint32_t match;
+    // Index of the entry after this value and everything nested in it
+    uint32_t next;
+} xjson_tape_entry;
+
+/* Kinds of values counted by the statistics */
+typedef enum xjson_value_type
+{
+    XJSON_VALUE_INTEGER = 0,
+    // Floats and doubles
+    XJSON_VALUE_FLOAT,
+    XJSON_VALUE_BOOL,
+    XJSON_VALUE_STRING,
+    XJSON_VALUE_OBJECT,
+    XJSON_VALUE_ARRAY,
+    XJSON_VALUE_TYPE_COUNT
+} xjson_value_type;
+
+/* Counters collected while reading/writing if XJSON_STATS is defined, see xjson_get_stats */
+typedef struct xjson_stats
+{
+    // Bytes of input read and output written, including any flushed to a sink
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    // Keys, values and the begin/end of objects and arrays
+    uint64_t tokens;
+    uint64_t keys;
+    uint64_t values[XJSON_VALUE_TYPE_COUNT];
+    // Calls of the string allocator and the length of the strings handed to it
+    uint64_t string_allocations;
+    uint64_t string_bytes;
+    // Steps over structural characters when reading json
+    uint64_t consume_calls;
+    uint32_t max_depth;
+    // Completed root objects/arrays and the time from their begin to their end
+    uint64_t documents;
+    uint64_t document_ns;
+} xjson_stats;
+
 /* Sets xjson to read-mode using the string pointed to by json_str up to length len */
 void xjson_setup_read(xjson* json, const char* json_str, size_t len);
+/* Same as xjson_setup_read, but first builds an index of all strings, objects and arrays and where they end in tape. 
+   Skipping over values then doesn't need to look at their contents. tape needs one entry per string, object and array, 
+   if it's too small (or the json isn't well-formed) xjson reads without an index and false is returned. */
+bool xjson_setup_read_indexed(xjson* json, const char* json_str, size_t len, xjson_tape_entry* tape, size_t tape_capacity);
 /* Sets xjson to write-mode and the json is written to buffer. If pretty_print is set to true, it'll produce a more readable output */
 void xjson_setup_write(xjson* json, bool pretty_print, char* buffer, size_t len);
+/* Sets xjson to write-mode, but instead of a single buffer the json is written in chunks of XJSON_SINK_CHUNK_SIZE bytes. 
+   flush is called with each full chunk and once more when the root object/array ends. It should return false if it failed. */
+void xjson_setup_write_sink(xjson* json, bool pretty_print, bool (*flush)(const char* data, size_t len, void* user), void* user);
+/* Sets xjson to measure-mode. The process function is called like in write-mode, but nothing is written and xjson_get_size 
+   returns the exact number of bytes it would have written afterwards. A json buffer needs one more for the zero-terminator. */
+void xjson_setup_measure(xjson* json, bool pretty_print);
+/* Sets xjson to read-mode using the contents of the file at path. The file is mapped into memory instead of being read, 
+   it stays mapped until xjson_close_file is called. Returns false if the file couldn't be mapped */
+bool xjson_setup_read_file(xjson* json, const char* path);
+/* Unmaps the file mapped by xjson_setup_read_file */
+void xjson_close_file(xjson* json);
+/* Frees the key index xjson allocated to read keys out of order. It's kept between documents otherwise, 
+   the xjson can be set up again afterwards */
+void xjson_free(xjson* json);
 /* Sets a custom string allocator method. Expects that the returned char* is zero-terminated! */
 void xjson_set_string_allocator(xjson* json, char* (*string_allocator)(const char* str, size_t size, void* mem_ctx));
+/* The default string allocator, every string is allocated with XJSON_MALLOC and has to be freed by the caller */
+char* xjson_malloc_string(const char* str, size_t size, void* mem_ctx);
 
-/* Returns either XJSON_STATE_READ or XJSON_STATE_WRITE */
+typedef struct xjson_arena_block xjson_arena_block;
+typedef struct xjson_arena
+{
+    // The block strings are currently allocated from, followed by all full blocks
+    xjson_arena_block* blocks;
+    // Size of newly allocated blocks
+    size_t block_size;
+    // Bytes handed out since the last reset, the most that was ever handed out and the bytes allocated for blocks
+    size_t used;
+    size_t high_water_mark;
+    size_t reserved;
+} xjson_arena;
+
+/* Sets up an arena that allocates memory in blocks of block_size bytes. No memory is allocated until the first string */
+void xjson_arena_init(xjson_arena* arena, size_t block_size);
+/* Frees all strings allocated from the arena at once. The memory is kept for the next document */
+void xjson_arena_reset(xjson_arena* arena);
+/* Frees all memory held by the arena */
+void xjson_arena_free(xjson_arena* arena);
+/* Allocates strings from the arena instead of using the string allocator */
+void xjson_set_arena(xjson* json, xjson_arena* arena);
+/* String allocator for arenas, mem_ctx is the xjson_arena */
+char* xjson_arena_allocate_string(const char* str, size_t size, void* mem_ctx);
+
+/* The output of an object written with xjson_object_begin_cached */
+typedef struct xjson_cache_entry
+{
+    uint64_t id;
+    uint64_t version;
+    // Set once the whole object has been recorded. It can only be used with the same pretty_print and format
+    bool valid;
+    bool pretty_print;
+    xjson_format format;
+    // The intendation the object was written at, so it can be re-indented when pretty printing
+    int depth;
+    uint8_t* data;
+    size_t len;
+    size_t capacity;
+
+    // While recording. The output from record_from on hasn't been copied yet, outer is the object recorded around this one
+    bool recording;
+    bool failed;
+    uint8_t* record_from;
+    struct xjson_cache_entry* outer;
+} xjson_cache_entry;
+
+typedef struct xjson_cache
+{
+    // Each id maps to one entry, ids that map to the same one replace each other
+    xjson_cache_entry* entries;
+    size_t mask;
+    // Lookups of xjson_object_begin_cached
+    uint64_t hits;
+    uint64_t misses;
+} xjson_cache;
+
+/* Sets up a cache for xjson_object_begin_cached with entry_count entries (rounded up to a power of two). 
+   Returns false if they couldn't be allocated */
+bool xjson_cache_init(xjson_cache* cache, size_t entry_count);
+/* Frees the entries and everything recorded in them */
+void xjson_cache_free(xjson_cache* cache);
+/* Uses cache for xjson_object_begin_cached, or no cache if it's NULL. A cache must only be used by one xjson at a time */
+void xjson_set_cache(xjson* json, xjson_cache* cache);
+
+/* Reads/writes CBOR instead of json with the same process functions. Call it right after one of the setup functions, 
+   which reset the format to json. Indexed reads only support json. */
+void xjson_set_format(xjson* json, xjson_format format);
+
+/* Returns XJSON_STATE_READ, XJSON_STATE_WRITE or XJSON_STATE_MEASURE */
 xjson_state xjson_get_state(xjson* json);
+/* Returns the number of bytes written to the output buffer so far, or counted in measure-mode. CBOR output isn't zero-terminated */
+size_t xjson_get_size(xjson* json);
+/* Returns a copy of the counters collected since the last reset. They are only collected if XJSON_STATS is defined 
+   (the same way in every file that includes xjson.h), otherwise all of them are zero. */
+xjson_stats xjson_get_stats(xjson* json);
+/* Sets all counters to zero */
+void xjson_reset_stats(xjson* json);
+/* Sets the error flag and error_message, e.g. for errors the process function finds itself */
+void xjson_error(xjson* json, const char* message);
 
 /* Begins a json object scope, all future value calls will use this object until a new scope is introduced */
 void xjson_object_begin(xjson* json, const char* key);
 /* Ends a json object scope */
 void xjson_object_end(xjson* json);
+/* Begins an object whose contents are identified by id and only change together with version. When writing, an object 
+   that is in the cache with the same id and version is copied from there and false is returned: it's complete, so 
+   neither its members nor xjson_object_end must be called. Otherwise it works like xjson_object_begin, returns true and 
+   the object is recorded into the cache until its xjson_object_end. Also returns false on error. */
+bool xjson_object_begin_cached(xjson* json, const char* key, uint64_t id, uint64_t version);
 /* Begins an array, all future value calls will use this array until a new scope is introduced */
 void xjson_array_begin(xjson* json, const char* key);
 /* Ends an array */
 void xjson_array_end(xjson* json);
 /* Will return true if an array end has been reached. Use this to parse/write an array with loops */
 bool xjson_array_reached_end(xjson* json, int counter, int size);
+/* Skips the value of key (or the next value if key is NULL) without parsing it, including any nested objects/arrays. 
+   Does nothing when writing. */
+void xjson_skip_value(xjson* json, const char* key);
+/* Skips all members of the current object that haven't been read yet, call xjson_object_end next. Does nothing when writing. */
+void xjson_object_skip_rest(xjson* json);
 /* Reads/Writes just the key, it means next value call should not supply a key (nullptr). Useful for hashmaps */
 void xjson_key(xjson* json, const char** key);
+/* Same as xjson_key, but when reading the key points into the json input instead of being allocated and isn't zero-terminated */
+void xjson_key_view(xjson* json, const char** key, size_t* len);
+/* Reads/Writes the key of the next value, which is then read/written without key (nullptr). The length and xjson_hash_key 
+   hash of key are given, so nothing is worked out per call. Returns false if the value must not be read/written, because 
+   the key is missing or there was an error. */
+bool xjson_key_hashed(xjson* json, const char* key, size_t key_len, uint32_t hash);
+/* The hash of a key used to look it up when reading (FNV-1a) */
+uint32_t xjson_hash_key(const char* key, size_t len);
 
 /* Read/write integer types */
 void xjson_u8(xjson* json, const char* key, uint8_t* val);
@@ -103,8 +287,29 @@ void xjson_double(xjson* json, const char* key, double* val);
 /* Read/write bool */
 void xjson_bool(xjson* json, const char* key, bool* val);
 
+/* Read/write a whole array of numbers at once. When reading, up to capacity values are stored in vals and count receives 
+   how many were read, an array with more values than that is an error. When writing, count values are written 
+   (capacity values if count is NULL). */
+void xjson_u8_array(xjson* json, const char* key, uint8_t* vals, size_t capacity, size_t* count);
+void xjson_u16_array(xjson* json, const char* key, uint16_t* vals, size_t capacity, size_t* count);
+void xjson_u32_array(xjson* json, const char* key, uint32_t* vals, size_t capacity, size_t* count);
+void xjson_u64_array(xjson* json, const char* key, uint64_t* vals, size_t capacity, size_t* count);
+void xjson_i8_array(xjson* json, const char* key, int8_t* vals, size_t capacity, size_t* count);
+void xjson_i16_array(xjson* json, const char* key, int16_t* vals, size_t capacity, size_t* count);
+void xjson_i32_array(xjson* json, const char* key, int32_t* vals, size_t capacity, size_t* count);
+void xjson_i64_array(xjson* json, const char* key, int64_t* vals, size_t capacity, size_t* count);
+void xjson_float_array(xjson* json, const char* key, float* vals, size_t capacity, size_t* count);
+void xjson_double_array(xjson* json, const char* key, double* vals, size_t capacity, size_t* count);
+/* When reading, returns how many values the number array that's next in the input can have at most, without reading 
+   it. Its key has to be read already (e.g. by xjson_key_hashed), this is for sizing the buffer of the xjson_*_array 
+   call that reads it. Returns 0 when writing, on error or if the next value isn't an array. */
+size_t xjson_peek_array_size(xjson* json);
+
 /* Read/write a string */
 void xjson_string(xjson* json, const char* key, const char** str);
+/* Read/write a string of length len. When reading, str points into the json input and isn't zero-terminated. 
+   Only strings that contain escape sequences are handed to the string allocator. */
+void xjson_string_view(xjson* json, const char* key, const char** str, size_t* len);
 
 typedef enum xjson_int_type
 {
@@ -118,6 +323,171 @@ typedef enum xjson_int_type
     XJSON_INT_TYPE_I64
 } xjson_int_type;
 
+/* Value types of struct fields, the integer types have the same values as xjson_int_type */
+typedef enum xjson_field_type
+{
+    XJSON_FIELD_U8 = XJSON_INT_TYPE_U8,
+    XJSON_FIELD_U16,
+    XJSON_FIELD_U32,
+    XJSON_FIELD_U64,
+    XJSON_FIELD_I8,
+    XJSON_FIELD_I16,
+    XJSON_FIELD_I32,
+    XJSON_FIELD_I64,
+    XJSON_FIELD_FLOAT,
+    XJSON_FIELD_DOUBLE,
+    XJSON_FIELD_BOOL,
+    // A const char*, see xjson_string
+    XJSON_FIELD_STRING,
+    // A nested struct with its own descriptor
+    XJSON_FIELD_NESTED
+} xjson_field_type;
+
+typedef struct xjson_struct_desc xjson_struct_desc;
+
+/* A member of a struct and the key it is stored under. Use the XJSON_FIELD macros to fill it in */
+typedef struct xjson_field
+{
+    const char* key;
+    size_t key_len;
+    xjson_field_type type;
+    // Offset of the member within the struct
+    size_t offset;
+    // Number of elements if the member is a fixed size array, 0 if it's a single value
+    size_t count;
+    // Descriptor of XJSON_FIELD_NESTED members
+    const xjson_struct_desc* desc;
+} xjson_field;
+
+/* Describes how a struct is read/written by xjson_struct */
+struct xjson_struct_desc
+{
+    const xjson_field* fields;
+    size_t field_count;
+    // sizeof the struct, the stride of arrays of it
+    size_t size;
+};
+
+#define XJSON_ARRAY_COUNT(type, member) (sizeof(((type*)0)->member) / sizeof(((type*)0)->member[0]))
+
+/* A member stored under its own name. field_type is one of xjson_field_type */
+#define XJSON_FIELD(type, member, field_type) \
+    { #member, sizeof(#member) - 1, field_type, offsetof(type, member), 0, NULL }
+/* Same as XJSON_FIELD, but stored under key, which has to be a string literal */
+#define XJSON_FIELD_KEY(type, member, key, field_type) \
+    { key, sizeof(key) - 1, field_type, offsetof(type, member), 0, NULL }
+/* A fixed size array member, e.g. float pos[3] */
+#define XJSON_FIELD_ARRAY(type, member, field_type) \
+    { #member, sizeof(#member) - 1, field_type, offsetof(type, member), XJSON_ARRAY_COUNT(type, member), NULL }
+/* A nested struct member described by desc */
+#define XJSON_FIELD_STRUCT(type, member, desc) \
+    { #member, sizeof(#member) - 1, XJSON_FIELD_NESTED, offsetof(type, member), 0, &(desc) }
+/* A fixed size array of nested structs described by desc */
+#define XJSON_FIELD_STRUCT_ARRAY(type, member, desc) \
+    { #member, sizeof(#member) - 1, XJSON_FIELD_NESTED, offsetof(type, member), XJSON_ARRAY_COUNT(type, member), &(desc) }
+/* The descriptor of type, fields is a static array of xjson_field */
+#define XJSON_STRUCT_DESC(type, fields) \
+    { fields, sizeof(fields) / sizeof(fields[0]), sizeof(type) }
+
+/* Called by xjson_ndjson_for_each for every line that isn't blank, json is set up to read just that line. line is the 
+   zero-based line number. Runs on the worker threads, so it's called concurrently for different lines. */
+typedef void* (*xjson_ndjson_callback)(xjson* json, size_t line, void* user);
+/* Receives the return value of the callback, one line at a time */
+typedef void (*xjson_ndjson_deliver)(void* result, size_t line, void* user);
+
+/* Processes newline-delimited json (JSON Lines) on thread_count threads, 0 uses one per core. Each thread reads lines 
+   with its own xjson object, strings are allocated from an arena per thread. Lines are processed in no particular order. 
+   If deliver is NULL, the strings are valid until the callback returns. Otherwise the results are handed to deliver, in 
+   line order if ordered is true or batch by batch as they finish if it's false, and the strings are valid until deliver 
+   returns. Threads are only used if XJSON_THREADS is defined. Returns the number of lines handed to the callback. */
+size_t xjson_ndjson_for_each(const char* buffer, size_t len, int thread_count, xjson_ndjson_callback callback, 
+    xjson_ndjson_deliver deliver, bool ordered, void* user);
+
+/* Reads/writes element index of an array, see xjson_parallel_array */
+typedef void (*xjson_element_callback)(xjson* json, size_t index, void* user);
+
+/* Reads/writes an array by calling element for each index. When writing, the elements are split across thread_count 
+   threads (0 uses one per core). Each thread writes its share with its own xjson object into a buffer of its own, and 
+   the buffers are then joined in order. The output is the same as with a loop over the elements. count values are 
+   written (capacity if count is NULL). When reading, the elements are read in order on the calling thread, up to 
+   capacity of them, and count receives how many were read. Threads are only used if XJSON_THREADS is defined. */
+void xjson_parallel_array(xjson* json, const char* key, size_t capacity, size_t* count, int thread_count, 
+    xjson_element_callback element, void* user);
+
+/* Reads/writes all fields of the struct at obj as an object, as described by desc. Keys are matched with their 
+   precomputed lengths and fields that are missing in the document are left untouched. */
+void xjson_struct(xjson* json, const char* key, void* obj, const xjson_struct_desc* desc);
+
+#ifndef XJSON_MAX_DEPTH
+#define XJSON_MAX_DEPTH 64
+#endif
+
+#ifndef XJSON_SINK_CHUNK_SIZE
+#define XJSON_SINK_CHUNK_SIZE 4096
+#endif
+
+#ifndef XJSON_NDJSON_BATCH_SIZE
+#define XJSON_NDJSON_BATCH_SIZE (256 * 1024)
+#endif
+
+#ifndef XJSON_NDJSON_ARENA_SIZE
+#define XJSON_NDJSON_ARENA_SIZE (64 * 1024)
+#endif
+
+#ifndef XJSON_ENCODED_KEY_SIZE
+#define XJSON_ENCODED_KEY_SIZE 64
+#endif
+
+/* A key encoded once up front with xjson_encode_key, so writing it is a single copy */
+typedef struct xjson_encoded_key
+{
+    const char* key;
+    size_t key_len;
+    uint32_t hash;
+    // ',' + the quoted and escaped key + ':', empty if it doesn't fit
+    size_t json_len;
+    char json[XJSON_ENCODED_KEY_SIZE];
+    // CBOR text head + the key, empty if it doesn't fit
+    size_t cbor_len;
+    char cbor[XJSON_ENCODED_KEY_SIZE];
+} xjson_encoded_key;
+
+/* Encodes key for both JSON and CBOR output and computes its hash. key isn't copied and must outlive encoded. Keys that 
+   don't fit into XJSON_ENCODED_KEY_SIZE bytes still work, they are just written like any other key. */
+void xjson_encode_key(xjson_encoded_key* encoded, const char* key, size_t key_len);
+/* Same as xjson_key_hashed for a key encoded by xjson_encode_key. When writing compact JSON, the ',' in front of the key 
+   is written in the same copy. */
+bool xjson_key_encoded(xjson* json, const xjson_encoded_key* key);
+
+/* An open object or array in read mode */
+typedef struct xjson_scope
+{
+    // Offset of the first token after the opening bracket
+    size_t begin;
+    // Offset of the closing bracket. Stays 0 until the object has been scanned for its keys or is known from the tape.
+    // For CBOR it's the offset past the last member/element (or of the break byte), once the map has been scanned
+    size_t end;
+    // The hash table of this object lives at key_index[index_base], index_mask is 0 if there is none
+    uint32_t index_base;
+    uint32_t index_mask;
+    bool is_array;
+    // Whether the keys have been scanned, even if no hash table could be built
+    bool scanned;
+    // CBOR only. Whether the map/array ends with a break byte, end is the offset of it if so
+    bool indefinite;
+    // CBOR only. The number of members/elements of a definite map/array and how many of them have been read in order
+    uint64_t count;
+    uint64_t read;
+} xjson_scope;
+
+/* A key hash table slot, maps the hash of a key to the offset of its opening quote */
+typedef struct xjson_key_slot
+{
+    // 0 marks an empty slot
+    uint32_t offset;
+    uint32_t hash;
+} xjson_key_slot;
+
 typedef struct xjson
 {
     // Will be passed to the string allocator function
@@ -126,6 +496,8 @@ typedef struct xjson
     xjson_state mode;
     // Will output json with newline/tab.
     bool pretty_print;
+    // Whether json or CBOR is read/written
+    xjson_format format;
     int intendation;
 
     // These point to the beginning/end and current location in either the write or read buffer
@@ -133,9 +505,49 @@ typedef struct xjson
     uint8_t* end;
     uint8_t* start;
 
+    // Read mode only. Open objects/arrays and the key hash tables of open objects, which are
+    // allocated from key_index like a stack. Used to look up keys regardless of their order.
+    // key_index is allocated on the first lookup out of order, grows as needed and is kept until xjson_free
+    xjson_scope scopes[XJSON_MAX_DEPTH];
+    xjson_key_slot* key_index;
+    uint32_t key_index_top;
+    uint32_t key_index_capacity;
+    // Number of open objects/arrays whose key is missing in the document, nothing is read while > 0
+    int missing_depth;
+
+    // Write mode only. Set if the next value needs a separating ',', or if xjson_key was just written and the value follows directly
+    bool needs_comma;
+    bool after_key;
+    // Sink mode only. The output is collected in sink_chunk and handed to flush whenever it fills up
+    bool (*flush)(const char* data, size_t len, void* user);
+    void* flush_user;
+    uint8_t sink_chunk[XJSON_SINK_CHUNK_SIZE];
+    // Measure mode only. The bytes that would have been written so far
+    size_t measure_size;
+    // Write mode only. See xjson_set_cache, cache_recording is the innermost object being recorded
+    xjson_cache* cache;
+    xjson_cache_entry* cache_recording;
+
+    // Indexed read only. The structural index and the entry of the last lookup, which is where the next one most likely is
+    xjson_tape_entry* tape;
+    uint32_t tape_count;
+    uint32_t tape_cursor;
+
+    // File read only. The mapping created by xjson_setup_read_file
+    void* file_data;
+    size_t file_size;
+    void* file_mapping;
+
     // The custom string allocator function
     char* (*string_allocator)(const char* str, size_t size, void* mem_ctx);
 
+#if defined(XJSON_STATS)
+    // Bytes before stats_mark have been counted. stats_document_begin is the time the current root object/array began
+    xjson_stats stats;
+    uint8_t* stats_mark;
+    uint64_t stats_document_begin;
+#endif
+
     // Error handling. Set to true on error + appropriate message in error_message.
     bool error;
     char error_message[256];
@@ -148,13 +560,61 @@ typedef struct xjson
 #endif // XJSON_H
 
 #ifdef XJSON_H_IMPLEMENTATION
+
+// SIMD kernels are picked at build time based on the target, define XJSON_NO_SIMD to always use the scalar code
+#if !defined(XJSON_NO_SIMD)
+    #if defined(__AVX2__)
+        #define XJSON_SIMD_AVX2
+        #define XJSON_SIMD_SSE2
+        #include <immintrin.h>
+    #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define XJSON_SIMD_SSE2
+        #include <emmintrin.h>
+    #endif
+#endif
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+#if defined(_WIN32)
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#if defined(XJSON_STATS)
+    #include <time.h>
+#endif
+
+// Worker threads of xjson_ndjson_for_each are opt-in. Define XJSON_THREADS and link with pthreads (not needed on Windows)
+#if defined(XJSON_THREADS) && !defined(_WIN32)
+    #include <pthread.h>
+#endif
+
+// Integer parsing loads 8 digits at a time on little-endian targets
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ || defined(_WIN32) || defined(__x86_64__) || defined(__i386__)
+    #define XJSON_LITTLE_ENDIAN
+#endif
+
 //----------------------------------------------------------------------------------
 // API implementation
 //----------------------------------------------------------------------------------
 void xjson_error(xjson* json, const char* message)
 {
     json->error = true;
-    if(json->mode == XJSON_STATE_READ)
+    if(json->mode == XJSON_STATE_READ && json->format == XJSON_FORMAT_CBOR)
+    {
+        // Binary data has no lines to show
+        sprintf(json->error_message, "Error (offset %zu): %s", (size_t)(json->current - json->start), message);
+    }
+    else if(json->mode == XJSON_STATE_READ)
     {
         // get line number and line index
         int line = 0;
@@ -181,6 +641,101 @@ void xjson_error(xjson* json, const char* message)
     }
 }
 
+// Counters of XJSON_STATS. Without it the XJSON_STATS_* macros expand to nothing
+#if defined(XJSON_STATS)
+uint64_t xjson_stats_now(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#else
+    return (uint64_t)((double)clock() * (1e9 / CLOCKS_PER_SEC));
+#endif
+}
+
+/* Counts the bytes read/written since the last call */
+void xjson_stats_bytes(xjson* json)
+{
+    // Nothing is written in measure-mode
+    if(json->mode == XJSON_STATE_READ)
+        json->stats.bytes_read += json->current - json->stats_mark;
+    else if(json->mode == XJSON_STATE_WRITE)
+        json->stats.bytes_written += json->current - json->stats_mark;
+    json->stats_mark = json->current;
+}
+
+void xjson_stats_value(xjson* json, xjson_value_type type, size_t count)
+{
+    if(json->error) return;
+    json->stats.values[type] += count;
+    json->stats.tokens += count;
+}
+
+void xjson_stats_key(xjson* json)
+{
+    if(json->error) return;
+    json->stats.keys++;
+    json->stats.tokens++;
+}
+
+/* Called before an object/array begins, the root starts the timer */
+void xjson_stats_scope_begin(xjson* json)
+{
+    if(json->intendation == 0) json->stats_document_begin = xjson_stats_now();
+}
+
+/* Called after an object/array ended */
+void xjson_stats_scope_end(xjson* json, xjson_value_type type)
+{
+    if(json->error) return;
+
+    json->stats.values[type]++;
+    json->stats.tokens += 2;
+    if((uint32_t)json->intendation + 1 > json->stats.max_depth) json->stats.max_depth = json->intendation + 1;
+
+    if(json->intendation == 0)
+    {
+        json->stats.documents++;
+        json->stats.document_ns += xjson_stats_now() - json->stats_document_begin;
+        xjson_stats_bytes(json);
+    }
+}
+
+/* Adds the counters of a helper xjson (e.g. a thread's) that don't overlap with what the parent counts itself */
+void xjson_stats_merge(xjson* json, const xjson_stats* stats)
+{
+    json->stats.tokens += stats->tokens;
+    json->stats.keys += stats->keys;
+    for(int i=0; i<XJSON_VALUE_TYPE_COUNT; i++) json->stats.values[i] += stats->values[i];
+    json->stats.string_allocations += stats->string_allocations;
+    json->stats.string_bytes += stats->string_bytes;
+    json->stats.consume_calls += stats->consume_calls;
+    if(stats->max_depth > json->stats.max_depth) json->stats.max_depth = stats->max_depth;
+}
+
+#define XJSON_STATS_ADD(json, counter, n) ((json)->stats.counter += (n))
+#define XJSON_STATS_VALUE(json, type, count) xjson_stats_value(json, type, count)
+#define XJSON_STATS_KEY(json) xjson_stats_key(json)
+#define XJSON_STATS_SCOPE_BEGIN(json) xjson_stats_scope_begin(json)
+#define XJSON_STATS_SCOPE_END(json, type) xjson_stats_scope_end(json, type)
+#define XJSON_STATS_BYTES(json) xjson_stats_bytes(json)
+#define XJSON_STATS_MARK(json) ((json)->stats_mark = (json)->current)
+#else
+#define XJSON_STATS_ADD(json, counter, n) ((void)0)
+#define XJSON_STATS_VALUE(json, type, count) ((void)0)
+#define XJSON_STATS_KEY(json) ((void)0)
+#define XJSON_STATS_SCOPE_BEGIN(json) ((void)0)
+#define XJSON_STATS_SCOPE_END(json, type) ((void)(type))
+#define XJSON_STATS_BYTES(json) ((void)0)
+#define XJSON_STATS_MARK(json) ((void)0)
+#endif
+
 bool xjson_is_white_space(char c)
 {
     return (c == ' ') ||
@@ -191,44 +746,204 @@ bool xjson_is_white_space(char c)
 		(c == '\r');
 }
 
-char xjson_lookback(xjson* json)
+/* Index of the lowest set bit, mask must not be 0 */
+uint32_t xjson_ctz(uint32_t mask)
 {
-    if(json->error) return 0;
-    if(json->current == json->start) return 0;
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (uint32_t)index;
+#else
+    return (uint32_t)__builtin_ctz(mask);
+#endif
+}
+
+/* Index of the lowest set bit, mask must not be 0 */
+uint32_t xjson_ctz64(uint64_t mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (uint32_t)index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if(_BitScanForward(&index, (uint32_t)mask)) return (uint32_t)index;
+    _BitScanForward(&index, (uint32_t)(mask >> 32));
+    return (uint32_t)index + 32;
+#else
+    return (uint32_t)__builtin_ctzll(mask);
+#endif
+}
+
+/* Number of set bits */
+uint64_t xjson_popcount64(uint64_t mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    return __popcnt64(mask);
+#elif defined(_MSC_VER)
+    return __popcnt((uint32_t)mask) + __popcnt((uint32_t)(mask >> 32));
+#else
+    return (uint64_t)__builtin_popcountll(mask);
+#endif
+}
+
+/* Returns a pointer to the first non white space character in [ptr, end), or end */
+uint8_t* xjson_skip_white_space(uint8_t* ptr, uint8_t* end)
+{
+    // Most runs are short (or empty) when not pretty printed, so check the first character on its own
+    if(ptr >= end || !xjson_is_white_space(*ptr)) return ptr;
+
+#if defined(XJSON_SIMD_AVX2)
+    {
+        // ' ' or '\t'..'\r', the range check is done with unsigned min/max
+        const __m256i space = _mm256_set1_epi8(' ');
+        const __m256i range_min = _mm256_set1_epi8('\t');
+        const __m256i range_max = _mm256_set1_epi8('\r');
+        while(ptr + 32 <= end)
+        {
+            __m256i chunk = _mm256_loadu_si256((const __m256i*)ptr);
+            __m256i in_range = _mm256_cmpeq_epi8(_mm256_max_epu8(_mm256_min_epu8(chunk, range_max), range_min), chunk);
+            __m256i white_space = _mm256_or_si256(in_range, _mm256_cmpeq_epi8(chunk, space));
+            uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(white_space);
+            if(mask != 0) return ptr + xjson_ctz(mask);
+            ptr += 32;
+        }
+    }
+#endif
+#if defined(XJSON_SIMD_SSE2)
+    {
+        const __m128i space = _mm_set1_epi8(' ');
+        const __m128i range_min = _mm_set1_epi8('\t');
+        const __m128i range_max = _mm_set1_epi8('\r');
+        while(ptr + 16 <= end)
+        {
+            __m128i chunk = _mm_loadu_si128((const __m128i*)ptr);
+            __m128i in_range = _mm_cmpeq_epi8(_mm_max_epu8(_mm_min_epu8(chunk, range_max), range_min), chunk);
+            __m128i white_space = _mm_or_si128(in_range, _mm_cmpeq_epi8(chunk, space));
+            uint32_t mask = ~(uint32_t)_mm_movemask_epi8(white_space) & 0xFFFF;
+            if(mask != 0) return ptr + xjson_ctz(mask);
+            ptr += 16;
+        }
+    }
+#endif
+
+    while(ptr < end && xjson_is_white_space(*ptr))
+    {
+        ptr++;
+    }
+    return ptr;
+}
+
+/* Returns a pointer to the first '"' or '\\' in [ptr, end), or end */
+uint8_t* xjson_scan_string(uint8_t* ptr, uint8_t* end)
+{
+#if defined(XJSON_SIMD_AVX2)
+    {
+        const __m256i quote = _mm256_set1_epi8('\"');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        while(ptr + 32 <= end)
+        {
+            __m256i chunk = _mm256_loadu_si256((const __m256i*)ptr);
+            __m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(special);
+            if(mask != 0) return ptr + xjson_ctz(mask);
+            ptr += 32;
+        }
+    }
+#endif
+#if defined(XJSON_SIMD_SSE2)
+    {
+        const __m128i quote = _mm_set1_epi8('\"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        while(ptr + 16 <= end)
+        {
+            __m128i chunk = _mm_loadu_si128((const __m128i*)ptr);
+            __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(special);
+            if(mask != 0) return ptr + xjson_ctz(mask);
+            ptr += 16;
+        }
+    }
+#endif
+
+    while(ptr < end && *ptr != '\"' && *ptr != '\\')
+    {
+        ptr++;
+    }
+    return ptr;
+}
 
-    uint8_t* ptr = json->current - 1;
-    while(ptr > json->start && xjson_is_white_space(*ptr))
+/* Returns a pointer to the first character in [ptr, end) that has to be escaped when written: '"', '\\' or a control character */
+const uint8_t* xjson_scan_escape(const uint8_t* ptr, const uint8_t* end)
+{
+#if defined(XJSON_SIMD_AVX2)
+    {
+        const __m256i quote = _mm256_set1_epi8('\"');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        const __m256i control_max = _mm256_set1_epi8(0x1F);
+        while(ptr + 32 <= end)
+        {
+            __m256i chunk = _mm256_loadu_si256((const __m256i*)ptr);
+            // Control characters are the ones that don't change by an unsigned min with 0x1F
+            __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control_max), chunk);
+            __m256i special = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)), control);
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(special);
+            if(mask != 0) return ptr + xjson_ctz(mask);
+            ptr += 32;
+        }
+    }
+#endif
+#if defined(XJSON_SIMD_SSE2)
+    {
+        const __m128i quote = _mm_set1_epi8('\"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i control_max = _mm_set1_epi8(0x1F);
+        while(ptr + 16 <= end)
+        {
+            __m128i chunk = _mm_loadu_si128((const __m128i*)ptr);
+            __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(chunk, control_max), chunk);
+            __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)), control);
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(special);
+            if(mask != 0) return ptr + xjson_ctz(mask);
+            ptr += 16;
+        }
+    }
+#endif
+
+    while(ptr < end && *ptr != '\"' && *ptr != '\\' && *ptr >= 0x20)
     {
-        ptr--;
+        ptr++;
     }
+    return ptr;
+}
 
-    return ptr > json->start ? *ptr : 0;
+char xjson_peek(xjson* json)
+{
+    // The input doesn't have to be zero-terminated, so never look past its end
+    return json->current < json->end ? *json->current : '\0';
 }
 
 char xjson_consume(xjson* json)
 {
     if(json->error) return 0;
+    XJSON_STATS_ADD(json, consume_calls, 1);
 
     if(json->current == json->end)
         return 0;
 
     // Consume any white space that might be there
-    char c = *(++json->current);
-    while(xjson_is_white_space(c))
-    {
-        if(json->current == json->end)
-            return 0;
-        c = *(++json->current);
-    }
+    json->current = xjson_skip_white_space(json->current + 1, json->end);
+    if(json->current == json->end)
+        return 0;
 
-    return c;
+    return *json->current;
 }
 
 void xjson_try(xjson* json, char expected_character)
 {
     if(json->error) return;
 
-    if(*json->current == expected_character)
+    if(xjson_peek(json) == expected_character)
         xjson_consume(json);
 }
 
@@ -236,7 +951,7 @@ void xjson_expect(xjson* json, char expected_character)
 {
     if(json->error) return;
 
-    if(*json->current != expected_character){
+    if(xjson_peek(json) != expected_character){
         xjson_error(json, "Unexpected token found.");
         return;
     }
@@ -248,6 +963,11 @@ void xjson_expect_token(xjson* json, const char* token, size_t len)
 {
     if(json->error) return;
 
+    if((size_t)(json->end - json->current) < len){
+        xjson_error(json, "Unexpected token found.");
+        return;
+    }
+
     for(int i=0; i<len; i++){
         if(*(json->current+i) != token[i]) {
            xjson_error(json, "Unexpected token found.");
@@ -256,619 +976,5585 @@ void xjson_expect_token(xjson* json, const char* token, size_t len)
     }
 
     json->current += len;
-    if(xjson_is_white_space(*json->current)){
+    if(xjson_is_white_space(xjson_peek(json))){
         xjson_consume(json);
     }
 }
 
-void xjson_expect_key(xjson* json, const char* key)
+uint32_t xjson_hash_key(const char* key, size_t len)
 {
-    xjson_expect(json, '\"');
-    if(json->error) return;
-
-    // We find the size of the key and advance the current pointer to the end of key
-    const uint8_t* key_start = json->current;
-    while(*json->current != '\"') {
-        xjson_consume(json);
-        if(json->error) return;
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for(size_t i=0; i<len; i++)
+    {
+        hash ^= (uint8_t)key[i];
+        hash *= 16777619u;
     }
-    size_t key_len = json->current - key_start;
+    return hash;
+}
 
-    // Then we compare the two to make sure they match
-    if(memcmp(key, key_start, key_len) != 0){
-        xjson_error(json, "Expected key does not match.");
-        return;
+/* Parses the 4 hex digits of a \\u escape at ptr. Returns false if they aren't valid */
+bool xjson_parse_hex4(const uint8_t* ptr, uint32_t* code_point)
+{
+    uint32_t value = 0;
+    for(int i=0; i<4; i++)
+    {
+        uint8_t c = ptr[i];
+        uint32_t digit;
+        if((uint8_t)(c - '0') <= 9) digit = c - '0';
+        else if((uint8_t)((c | 0x20) - 'a') <= 5) digit = (c | 0x20) - 'a' + 10;
+        else return false;
+        value = (value << 4) | digit;
     }
-
-    xjson_expect(json, '\"');
-    xjson_expect(json, ':');
+    *code_point = value;
+    return true;
 }
 
-void xjson_expect_and_parse_int(xjson* json, int64_t* out_value)
+/* Decodes the escape sequence at ptr (its backslash) into out as UTF-8, at most 4 bytes. Returns a pointer past 
+   the sequence, or NULL if it isn't valid. All of it is read before out is written, so out may point into the sequence */
+const uint8_t* xjson_decode_escape(const uint8_t* ptr, const uint8_t* end, uint8_t* out, size_t* out_len)
 {
-    if(json->error) return;
+    if(end - ptr < 2) return NULL;
+    uint8_t c = ptr[1];
+    ptr += 2;
 
-    uint8_t* end_ptr;
-    int64_t value = strtoll((char*)json->current, (char**)&end_ptr, 10);
-    if(json->current == end_ptr)
+    uint32_t code_point;
+    switch(c)
     {
-        // This means we couldn't parse the integer properly.
-        xjson_error(json, "Invalid integer found. Couldn't parse value.");
-        return;
+    case '\"': code_point = '\"'; break;
+    case '\\': code_point = '\\'; break;
+    case '/': code_point = '/'; break;
+    case 'b': code_point = '\b'; break;
+    case 'f': code_point = '\f'; break;
+    case 'n': code_point = '\n'; break;
+    case 'r': code_point = '\r'; break;
+    case 't': code_point = '\t'; break;
+    case 'u':
+        if(end - ptr < 4 || !xjson_parse_hex4(ptr, &code_point)) return NULL;
+        ptr += 4;
+
+        // Characters outside the BMP are written as a surrogate pair
+        if(code_point >= 0xD800 && code_point <= 0xDBFF)
+        {
+            uint32_t low;
+            if(end - ptr < 6 || ptr[0] != '\\' || ptr[1] != 'u' || !xjson_parse_hex4(ptr + 2, &low) || low < 0xDC00 || low > 0xDFFF) 
+                return NULL;
+            ptr += 6;
+            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+        }
+        else if(code_point >= 0xDC00 && code_point <= 0xDFFF)
+        {
+            return NULL;
+        }
+        break;
+    default:
+        return NULL;
     }
-    *out_value = value;
 
-    // Move pointer to end of number value + ensure all white space is consumed
-    json->current = end_ptr;
-    if(xjson_is_white_space(*json->current)){
-        xjson_consume(json);
+    // UTF-8 encode
+    if(code_point < 0x80)
+    {
+        out[0] = (uint8_t)code_point;
+        *out_len = 1;
     }
+    else if(code_point < 0x800)
+    {
+        out[0] = (uint8_t)(0xC0 | (code_point >> 6));
+        out[1] = (uint8_t)(0x80 | (code_point & 0x3F));
+        *out_len = 2;
+    }
+    else if(code_point < 0x10000)
+    {
+        out[0] = (uint8_t)(0xE0 | (code_point >> 12));
+        out[1] = (uint8_t)(0x80 | ((code_point >> 6) & 0x3F));
+        out[2] = (uint8_t)(0x80 | (code_point & 0x3F));
+        *out_len = 3;
+    }
+    else
+    {
+        out[0] = (uint8_t)(0xF0 | (code_point >> 18));
+        out[1] = (uint8_t)(0x80 | ((code_point >> 12) & 0x3F));
+        out[2] = (uint8_t)(0x80 | ((code_point >> 6) & 0x3F));
+        out[3] = (uint8_t)(0x80 | (code_point & 0x3F));
+        *out_len = 4;
+    }
+    return ptr;
 }
 
-void xjson_expect_and_parse_double(xjson* json, double* out_value)
+/* Hashes a key as it is in the json, between its quotes. Escape sequences are hashed decoded, so the hash is the 
+   same as xjson_hash_key of the key that was written */
+uint32_t xjson_hash_json_key(const uint8_t* str, size_t len)
 {
-    if(json->error) return;
-
-    uint8_t* end_ptr;
-    double value = strtod((char*)json->current, (char**)&end_ptr);
-    if(json->current == end_ptr)
+    const uint8_t* end = str + len;
+    uint32_t hash = 2166136261u;
+    while(str < end)
     {
-        // This means we couldn't parse the integer properly.
-        xjson_error(json, "Invalid double found. Couldn't parse value.");
-        return;
-    }
-    *out_value = value;
+        uint8_t decoded[4];
+        size_t decoded_len = 1;
+        if(*str != '\\')
+        {
+            decoded[0] = *str++;
+        }
+        else
+        {
+            const uint8_t* next = xjson_decode_escape(str, end, decoded, &decoded_len);
+            // An invalid escape can't match any key, so its hash doesn't matter
+            if(next == NULL) next = end;
+            str = next;
+        }
 
-    // Move pointer to end of number value
-    json->current = end_ptr;
-    if(xjson_is_white_space(*json->current)){
-        xjson_consume(json);
+        for(size_t i=0; i<decoded_len; i++)
+        {
+            hash ^= decoded[i];
+            hash *= 16777619u;
+        }
     }
+    return hash;
 }
 
-void xjson_expect_and_parse_string(xjson* json, const char** str)
+/* Compares the key whose first character is at str with key, decoding escape sequences in the json. Returns a 
+   pointer to its closing quote if it matches, otherwise NULL */
+const uint8_t* xjson_match_key(xjson* json, const uint8_t* str, const char* key, size_t key_len)
 {
-    xjson_expect(json, '\"');
-    if(json->error) return;
+    // Most keys have no escapes and are compared in one go
+    if((size_t)(json->end - str) > key_len && memcmp(str, key, key_len) == 0 && str[key_len] == '\"') return str + key_len;
+    if(str >= json->end || key_len == 0 || (*str != (uint8_t)key[0] && *str != '\\')) return NULL;
 
-    uint8_t* str_start = json->current;
-
-    while(*json->current != '\"')
+    size_t matched = 0;
+    for(;;)
     {
-        xjson_consume(json);
-        if(json->error) return;
+        const uint8_t* escape = xjson_scan_string((uint8_t*)str, json->end);
+        size_t run = escape - str;
+        if(run > key_len - matched || memcmp(str, key + matched, run) != 0) return NULL;
+        matched += run;
+        str = escape;
+        if(str >= json->end) return NULL;
+        if(*str == '\"') return matched == key_len ? str : NULL;
+
+        uint8_t decoded[4];
+        size_t decoded_len;
+        str = xjson_decode_escape(str, json->end, decoded, &decoded_len);
+        if(str == NULL || decoded_len > key_len - matched || memcmp(decoded, key + matched, decoded_len) != 0) return NULL;
+        matched += decoded_len;
     }
-
-    size_t str_len = json->current - str_start;
-    *str = json->string_allocator((char*)str_start, str_len, json->mem_ctx);
-    
-    xjson_expect(json, '\"');
 }
 
-void xjson_expect_and_parse_bool(xjson* json, bool* val)
+bool xjson_key_matches(xjson* json, size_t offset, const char* key, size_t key_len)
 {
-    if(json->error) return;
-
-    if(*json->current == 't')
-    {
-        xjson_expect_token(json, "true", 4);
-        if(!json->error)
-            *val = true;
-    }
-    else if(*json->current == 'f')
-    {
-        xjson_expect_token(json, "false", 5);
-        if(!json->error)
-            *val = false;
-    }
-    else 
-    {
-        xjson_error(json, "Unexpected token whilst parsing bool.");
-    }
+    return xjson_match_key(json, json->start + offset + 1, key, key_len) != NULL;
 }
 
-void xjson_print_token(xjson* json, const char* token, size_t len)
+void xjson_expect_key(xjson* json, const char* key, size_t key_len)
 {
     if(json->error) return;
 
-    if(json->current + len > json->end)
+    // We compare the key and make sure it's terminated right after
+    const uint8_t* key_end = xjson_peek(json) == '\"' ? xjson_match_key(json, json->current + 1, key, key_len) : NULL;
+    if(key_end == NULL)
     {
-       xjson_error(json, "Write buffer is too small to write to. Abort.");
+        xjson_error(json, "Expected key does not match.");
+        return;
     }
 
-    strncpy((char*)json->current, token, len);
-    json->current += len;
+    // Advance the current pointer to the end of key
+    json->current = (uint8_t*)key_end;
+    xjson_expect(json, '\"');
+    xjson_expect(json, ':');
 }
 
-void xjson_print_key(xjson* json, const char* key)
+//----------------------------------------------------------------------------------
+// Structural index
+//
+// xjson_setup_read_indexed runs a first pass over the whole document, 64 bytes at a time, to find all strings, 
+// objects and arrays and where each of them ends. Bitmasks of quotes, backslashes and brackets are made with SIMD 
+// compares. Escaped quotes are removed with carry-propagating bit arithmetic, a prefix-xor of the remaining quotes 
+// then gives the bytes inside strings, and brackets inside strings are dropped. Brackets are matched with a stack.
+// ':' and ',' are always the next token after a value, so they aren't recorded.
+//----------------------------------------------------------------------------------
+
+/* Bitmasks of the 64 bytes at ptr, bit i is set if byte i is the character */
+typedef struct xjson_block_masks
 {
-    if(json->error) return;
-    xjson_print_token(json, "\"", 1);
-    xjson_print_token(json, key, strlen(key));
-    xjson_print_token(json, "\"", 1);
-    xjson_print_token(json, ":", 1);
-}
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t open;
+    uint64_t close;
+} xjson_block_masks;
 
-void xjson_print_new_line(xjson* json)
+xjson_block_masks xjson_classify_block(const uint8_t* ptr)
 {
-    if(json->error) return;
-    xjson_print_token(json, "\n", 1);
-    for(int i=0; i<json->intendation; i++)
+    xjson_block_masks masks;
+#if defined(XJSON_SIMD_AVX2)
+    const __m256i quote = _mm256_set1_epi8('\"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    // '[' and ']' are '{' and '}' without bit 0x20, so setting it lets one compare find both
+    const __m256i bracket_bit = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    __m256i low = _mm256_loadu_si256((const __m256i*)ptr);
+    __m256i high = _mm256_loadu_si256((const __m256i*)(ptr + 32));
+    __m256i folded_low = _mm256_or_si256(low, bracket_bit);
+    __m256i folded_high = _mm256_or_si256(high, bracket_bit);
+    __m256i open_low = _mm256_cmpeq_epi8(folded_low, open);
+    __m256i open_high = _mm256_cmpeq_epi8(folded_high, open);
+    __m256i close_low = _mm256_cmpeq_epi8(folded_low, close);
+    __m256i close_high = _mm256_cmpeq_epi8(folded_high, close);
+    masks.quote = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, quote)) | 
+        ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, quote)) << 32);
+    masks.backslash = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, backslash)) | 
+        ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, backslash)) << 32);
+    masks.open = (uint32_t)_mm256_movemask_epi8(open_low) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(open_high) << 32);
+    masks.close = (uint32_t)_mm256_movemask_epi8(close_low) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(close_high) << 32);
+#elif defined(XJSON_SIMD_SSE2)
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i bracket_bit = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    masks.quote = 0;
+    masks.backslash = 0;
+    masks.open = 0;
+    masks.close = 0;
+    for(int i=0; i<4; i++)
     {
-        xjson_print_token(json, "\t", 1);
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(ptr + i * 16));
+        __m128i folded = _mm_or_si128(chunk, bracket_bit);
+        __m128i open_chunk = _mm_cmpeq_epi8(folded, open);
+        __m128i close_chunk = _mm_cmpeq_epi8(folded, close);
+        masks.quote |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote)) << (i * 16);
+        masks.backslash |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslash)) << (i * 16);
+        masks.open |= (uint64_t)(uint32_t)_mm_movemask_epi8(open_chunk) << (i * 16);
+        masks.close |= (uint64_t)(uint32_t)_mm_movemask_epi8(close_chunk) << (i * 16);
+    }
+#else
+    masks.quote = 0;
+    masks.backslash = 0;
+    masks.open = 0;
+    masks.close = 0;
+    for(int i=0; i<64; i++)
+    {
+        uint8_t c = ptr[i];
+        masks.quote |= (uint64_t)(c == '\"') << i;
+        masks.backslash |= (uint64_t)(c == '\\') << i;
+        masks.open |= (uint64_t)(c == '{' || c == '[') << i;
+        masks.close |= (uint64_t)(c == '}' || c == ']') << i;
     }
+#endif
+    return masks;
 }
 
-void xjson_setup_read(xjson* json, const char* str, size_t len)
+/* Returns the characters that are escaped by an odd number of preceding backslashes. 
+   prev_escaped carries whether the first character of the next block is escaped. */
+uint64_t xjson_find_escaped(uint64_t backslash, uint64_t* prev_escaped)
 {
-    XJSON_ASSERT(json);
-    XJSON_ASSERT(str);
+    const uint64_t even_bits = 0x5555555555555555ull;
+
+    // A backslash that is itself escaped doesn't escape anything
+    backslash &= ~*prev_escaped;
+    uint64_t follows_escape = (backslash << 1) | *prev_escaped;
+
+    // Each run of backslashes escapes the character after it if its length is odd. Adding the start of every run 
+    // that begins on an odd bit to the backslashes carries through the run, which leaves the end parity in the sum.
+    uint64_t odd_sequence_starts = backslash & ~even_bits & ~follows_escape;
+    uint64_t sequences_starting_on_even_bits = odd_sequence_starts + backslash;
+    *prev_escaped = sequences_starting_on_even_bits < odd_sequence_starts;
+    uint64_t invert_mask = sequences_starting_on_even_bits << 1;
+    return (even_bits ^ invert_mask) & follows_escape;
+}
 
-    json->start = (uint8_t*)str;
-    json->current = (uint8_t*)str;
-    json->end = (uint8_t*)(str+len);
-    json->mode = XJSON_STATE_READ;
+/* Bit i of the result is the xor of bits 0..i of x */
+uint64_t xjson_prefix_xor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
 }
 
-void xjson_setup_write(xjson* json, bool pretty_print, char* buffer, size_t len)
+/* Builds the structural index of the document into tape. Returns the number of entries, or -1 if it 
+   doesn't fit or the brackets don't match */
+int64_t xjson_build_tape(const uint8_t* str, size_t len, xjson_tape_entry* tape, size_t tape_capacity)
 {
-    XJSON_ASSERT(json);
-    XJSON_ASSERT(buffer);
+    // Offsets are stored as uint32, 0 isn't a valid end offset though so the document can use the whole range
+    if(len > UINT32_MAX) return -1;
+
+    uint32_t stack[XJSON_MAX_DEPTH];
+    int depth = 0;
+    uint32_t count = 0;
+    // Entry of the string currently open, is UINT32_MAX if there's none
+    uint32_t open_string = UINT32_MAX;
+    uint64_t prev_escaped = 0;
+    uint64_t prev_in_string = 0;
+
+    for(size_t block=0; block < len; block += 64)
+    {
+        // The last block is padded with spaces
+        uint8_t padded[64];
+        const uint8_t* ptr = str + block;
+        if(len - block < 64)
+        {
+            memset(padded, ' ', 64);
+            memcpy(padded, ptr, len - block);
+            ptr = padded;
+        }
 
-    json->pretty_print = pretty_print;
-    json->start = (uint8_t*)buffer;
-    json->current = (uint8_t*)buffer;
-    json->end = (uint8_t*)(buffer+len);
-    json->mode = XJSON_STATE_WRITE;
-}
+        xjson_block_masks masks = xjson_classify_block(ptr);
+        uint64_t quotes = masks.quote & ~xjson_find_escaped(masks.backslash, &prev_escaped);
+        uint64_t in_string = xjson_prefix_xor(quotes) ^ prev_in_string;
+        prev_in_string = (uint64_t)((int64_t)in_string >> 63);
 
-void xjson_set_string_allocator(xjson* json, char* (*string_allocator)(const char* str, size_t size, void* mem_ctx))
-{
-    XJSON_ASSERT(json);
-    XJSON_ASSERT(string_allocator);
+        // Opening quotes are inside the string in the prefix-xor, closing quotes aren't
+        uint64_t structurals = quotes | ((masks.open | masks.close) & ~in_string);
+        while(structurals != 0)
+        {
+            uint32_t bit = (uint32_t)xjson_ctz64(structurals);
+            structurals &= structurals - 1;
+            uint32_t offset = (uint32_t)(block + bit);
+            uint8_t c = ptr[bit];
 
-    json->string_allocator = string_allocator;
-}
+            if(c == '\"')
+            {
+                if(open_string != UINT32_MAX)
+                {
+                    tape[open_string].match = offset;
+                    open_string = UINT32_MAX;
+                    continue;
+                }
+                if(count >= tape_capacity) return -1;
+                open_string = count;
+                tape[count].next = count + 1;
+            }
+            else if(c == '{' || c == '[')
+            {
+                if(count >= tape_capacity || depth >= XJSON_MAX_DEPTH) return -1;
+                stack[depth++] = count;
+            }
+            else
+            {
+                if(depth == 0) return -1;
+                xjson_tape_entry* open = &tape[stack[--depth]];
+                if((c == '}') != (str[open->offset] == '{')) return -1;
+                open->match = offset;
+                open->next = count;
+                continue;
+            }
 
-xjson_state xjson_get_state(xjson* json)
-{
-    XJSON_ASSERT(json);
+            tape[count].offset = offset;
+            tape[count].match = 0;
+            count++;
+        }
+    }
 
-    return json->mode;
+    if(depth != 0 || open_string != UINT32_MAX) return -1;
+    return count;
 }
 
-void xjson_object_begin(xjson* json, const char* key)
+/* Returns a pointer to the bracket closing the object/array that starts at ptr, or end if there is none. 
+   Uses the same block masks as the tape, so the contents are never looked at byte by byte. */
+uint8_t* xjson_find_container_end(uint8_t* ptr, uint8_t* end)
 {
-    XJSON_ASSERT(json);
-    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+    uint64_t depth = 0;
+    uint64_t prev_escaped = 0;
+    uint64_t prev_in_string = 0;
 
-    if(json->error) return;
-
-    if(json->mode == XJSON_STATE_READ){
-        if(key != NULL){
-            xjson_expect_key(json, key);
+    for(; ptr < end; ptr += 64)
+    {
+        // The last block is padded with spaces
+        uint8_t padded[64];
+        const uint8_t* block = ptr;
+        if(end - ptr < 64)
+        {
+            memset(padded, ' ', 64);
+            memcpy(padded, ptr, end - ptr);
+            block = padded;
         }
 
-        xjson_expect(json, '{');
-    }
-    else {
-        if(key != NULL){
-            if(json->pretty_print) xjson_print_new_line(json);
-            xjson_print_key(json, key);
-        }
-        else if(json->pretty_print && xjson_lookback(json) != ':' && json->intendation != 0)
+        xjson_block_masks masks = xjson_classify_block(block);
+        uint64_t quotes = masks.quote & ~xjson_find_escaped(masks.backslash, &prev_escaped);
+        uint64_t in_string = xjson_prefix_xor(quotes) ^ prev_in_string;
+        prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+
+        uint64_t open = masks.open & ~in_string;
+        uint64_t close = masks.close & ~in_string;
+
+        // The depth can only reach 0 in this block if there are at least as many closing brackets
+        uint64_t close_count = xjson_popcount64(close);
+        if(close_count < depth)
         {
-            xjson_print_new_line(json);
+            depth += xjson_popcount64(open) - close_count;
+            continue;
         }
 
-        xjson_print_token(json, "{", 1);
+        uint64_t brackets = open | close;
+        while(brackets != 0)
+        {
+            uint64_t bit = brackets & (0 - brackets);
+            brackets ^= bit;
+            if(open & bit)
+            {
+                depth++;
+            }
+            else if(--depth == 0)
+            {
+                return ptr + xjson_ctz64(bit);
+            }
+        }
     }
-    json->intendation += 1;
+    return end;
 }
 
-void xjson_object_end(xjson* json)
+/* Returns the tape entry of the string/object/array starting at ptr, or NULL if there is none. The cursor is left 
+   right behind the entry, callers that skip the value move it to the entry's next. */
+xjson_tape_entry* xjson_tape_find(xjson* json, const uint8_t* ptr)
 {
-    XJSON_ASSERT(json);
-    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
-    XJSON_ASSERT(json->intendation > 0);
+    if(json->tape == NULL || ptr >= json->end) return NULL;
 
-    if(json->error) return;
+    uint32_t offset = (uint32_t)(ptr - json->start);
+    uint32_t i = json->tape_cursor;
 
-    json->intendation -= 1;
+    // Values are mostly visited in document order, so walk forward from the last lookup. Values that end before 
+    // offset are stepped over as a whole, so only the siblings and parents in between are looked at.
+    if(i < json->tape_count && json->tape[i].offset <= offset)
+    {
+        while(i < json->tape_count && json->tape[i].offset < offset)
+        {
+            i = json->tape[i].match < offset ? json->tape[i].next : i + 1;
+        }
+        if(i < json->tape_count && json->tape[i].offset == offset)
+        {
+            json->tape_cursor = i + 1;
+            return &json->tape[i];
+        }
+        // Numbers and literals have no entry, the next lookup starts from here
+        json->tape_cursor = i;
+        return NULL;
+    }
 
-    if(json->mode == XJSON_STATE_READ)
+    // Otherwise it's behind the cursor (e.g. after a jump through the key index), binary search for it
+    uint32_t low = 0;
+    uint32_t high = i < json->tape_count ? i : json->tape_count;
+    while(low < high)
     {
-        xjson_expect(json, '}');
-        xjson_try(json, ',');
+        uint32_t mid = low + (high - low) / 2;
+        if(json->tape[mid].offset < offset) low = mid + 1;
+        else high = mid;
     }
-    else 
+    if(low < json->tape_count && json->tape[low].offset == offset)
     {
-        // This is to overwrite the previous ',' insertion
-        json->current--;
-
-        // Special case for empty objects;
-        if(*json->current == '{')
-            json->current++;
-
-        if(json->pretty_print) xjson_print_new_line(json);
-        xjson_print_token(json, "}", 1);
-        xjson_print_token(json, ",", 1);
+        json->tape_cursor = low + 1;
+        return &json->tape[low];
     }
+    return NULL;
+}
 
-    // Special case for closing the root object, null-terminate the output string
-    if(json->intendation == 0 && json->mode == XJSON_STATE_WRITE)
+/* Returns a pointer to the closing quote of the string starting at ptr, or end if there is none */
+uint8_t* xjson_find_string_end(xjson* json, uint8_t* ptr)
+{
+    for(;;)
     {
-        *(--json->current) = '\0';
+        ptr = xjson_scan_string(ptr, json->end);
+        if(ptr >= json->end) return json->end;
+        if(*ptr == '\"') return ptr;
+
+        // Skip the escaped character
+        if(json->end - ptr <= 2) return json->end;
+        ptr += 2;
     }
 }
 
-void xjson_array_begin(xjson* json, const char* key)
+/* Skips over the value at the current location, including any nested objects/arrays */
+void xjson_skip_current_value(xjson* json)
 {
-    XJSON_ASSERT(json);
-    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
-
     if(json->error) return;
 
-    if(json->mode == XJSON_STATE_READ)
+    uint8_t* ptr = json->current;
+    xjson_tape_entry* entry = xjson_tape_find(json, ptr);
+    if(entry != NULL)
     {
-        if(key != NULL){
-            xjson_expect_key(json, key);
-        }
-
-        xjson_expect(json, '[');
+        // Where the string/object/array ends is already known
+        ptr = json->start + entry->match;
+        json->tape_cursor = entry->next;
     }
-    else 
+    else if(xjson_peek(json) == '\"')
+    {
+        ptr = xjson_find_string_end(json, ptr + 1);
+    }
+    else if(xjson_peek(json) == '{' || xjson_peek(json) == '[')
+    {
+        ptr = xjson_find_container_end(ptr, json->end);
+    }
+    else
     {
-        if(key != NULL){
-            if(json->pretty_print) xjson_print_new_line(json);
-            xjson_print_key(json, key);
+        // Numbers and literals run until the next delimiter
+        while(ptr < json->end && *ptr != ',' && *ptr != '}' && *ptr != ']' && !xjson_is_white_space(*ptr))
+        {
+            ptr++;
         }
-        else if(json->pretty_print && xjson_lookback(json) != ':')
+
+        if(ptr == json->current)
         {
-            xjson_print_new_line(json);
+            xjson_error(json, "Unexpected token found.");
+            return;
         }
 
-        xjson_print_token(json, "[", 1);
+        json->current = ptr;
+        if(xjson_is_white_space(xjson_peek(json))){
+            xjson_consume(json);
+        }
+        return;
     }
-    json->intendation += 1;
-}
-
-void xjson_array_end(xjson* json)
-{
-    XJSON_ASSERT(json);
-    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
-    XJSON_ASSERT(json->intendation > 0);
-
-    if(json->error) return;
-
-    json->intendation -= 1;
 
-    if(json->mode == XJSON_STATE_READ)
-    {
-        xjson_expect(json, ']');
-        xjson_try(json, ',');
-    }
-    else 
+    if(ptr >= json->end)
     {
-        json->current--;
-        
-        // Special case for empty arrays;
-        if(*json->current == '[')
-            json->current++;
-        
-        if(json->pretty_print) xjson_print_new_line(json);
-        xjson_print_token(json, "]", 1);
-        xjson_print_token(json, ",", 1);
+        xjson_error(json, "Unexpected end of json found.");
+        return;
     }
+
+    // Move past the closing quote/bracket
+    json->current = ptr;
+    xjson_consume(json);
 }
 
-// TODO: Find a better way to handle this. It's not very nice :(
-bool xjson_array_reached_end(xjson* json, int current, int size)
+/* Moves from the key of an object member to its value. Returns the key length, key_start points to the key */
+size_t xjson_skip_key(xjson* json, const uint8_t** key_start)
 {
-    if(json->mode == XJSON_STATE_READ)
+    if(json->error) return 0;
+    if(xjson_peek(json) != '\"')
     {
-        if(*json->current == ']' || json->error)
-            return true;
-        
-        return false;
+        xjson_error(json, "Unexpected token found.");
+        return 0;
     }
-    
-    return current >= size;
+
+    *key_start = json->current + 1;
+    uint8_t* key_end = xjson_find_string_end(json, json->current + 1);
+    if(key_end >= json->end)
+    {
+        xjson_error(json, "Unexpected end of json found.");
+        return 0;
+    }
+
+    json->current = key_end;
+    xjson_expect(json, '\"');
+    xjson_expect(json, ':');
+    return key_end - *key_start;
 }
 
-void xjson_key(xjson* json, const char** key)
+/* Moves from the key of an object member past its value to the next member. Returns the key length, key_start points 
+   to the key. With the tape, neither the key nor the value are looked at. */
+size_t xjson_skip_member(xjson* json, const uint8_t** key_start)
 {
-    XJSON_ASSERT(json);
-    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+    if(json->error) return 0;
 
-    if(json->mode == XJSON_STATE_READ)
+    size_t key_len;
+    xjson_tape_entry* entry = xjson_peek(json) == '\"' ? xjson_tape_find(json, json->current) : NULL;
+    if(entry != NULL)
     {
-        xjson_expect_and_parse_string(json, key);
+        *key_start = json->current + 1;
+        key_len = entry->match - entry->offset - 1;
+        json->current = json->start + entry->match;
+        xjson_expect(json, '\"');
         xjson_expect(json, ':');
     }
     else
     {
-        if(json->pretty_print) xjson_print_new_line(json);
-        xjson_print_key(json, *key);
+        key_len = xjson_skip_key(json, key_start);
     }
+    xjson_skip_current_value(json);
+    xjson_try(json, ',');
+    return key_len;
 }
 
-void xjson_integer(xjson* json, const char* key, void* val, xjson_int_type type)
+/* Makes sure key_index has room for count more slots above key_index_top. Tables are addressed by 
+   index_base, so they stay valid when key_index moves. Returns false if the memory couldn't be allocated */
+bool xjson_reserve_key_index(xjson* json, uint32_t count)
 {
-    XJSON_ASSERT(json);
-    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
-    XJSON_ASSERT(val);
+    if(count > UINT32_MAX - json->key_index_top) return false;
+    uint32_t needed = json->key_index_top + count;
+    if(needed <= json->key_index_capacity) return true;
 
-    if(json->mode == XJSON_STATE_READ)
+    uint32_t capacity = json->key_index_capacity < 64 ? 64 : json->key_index_capacity;
+    while(capacity < needed) capacity = capacity > UINT32_MAX / 2 ? UINT32_MAX : capacity * 2;
+
+    xjson_key_slot* key_index = (xjson_key_slot*)XJSON_MALLOC(capacity * sizeof(xjson_key_slot));
+    if(key_index == NULL) return false;
+    if(json->key_index != NULL)
+    {
+        // Slots above key_index_top may already be in use by the table that is being built
+        memcpy(key_index, json->key_index, json->key_index_capacity * sizeof(xjson_key_slot));
+        XJSON_FREE(json->key_index);
+    }
+    json->key_index = key_index;
+    json->key_index_capacity = capacity;
+    return true;
+}
+
+/* Turns the count slots collected at key_index_top into the hash table of scope, with a load factor <= 0.5. 
+   It's built right behind the list and moved in place. Nothing is built if fits is false */
+void xjson_hash_key_index(xjson* json, xjson_scope* scope, uint32_t count, bool fits)
+{
+    uint32_t capacity = 2;
+    while(capacity < count * 2) capacity *= 2;
+    if(!fits || count == 0 || !xjson_reserve_key_index(json, count + capacity)) return;
+
+    xjson_key_slot* slots = json->key_index + json->key_index_top;
+    xjson_key_slot* table = slots + count;
+    memset(table, 0, capacity * sizeof(xjson_key_slot));
+    for(uint32_t i=0; i<count; i++)
     {
-        if(key != NULL)
+        uint32_t slot = slots[i].hash & (capacity - 1);
+        while(table[slot].offset != 0)
         {
-            xjson_expect_key(json, key);
+            slot = (slot + 1) & (capacity - 1);
         }
+        table[slot] = slots[i];
+    }
+    memmove(slots, table, capacity * sizeof(xjson_key_slot));
 
-        int64_t number;
-        xjson_expect_and_parse_int(json, &number);
-        if(json->error) return;
+    scope->index_mask = capacity - 1;
+    json->key_index_top += capacity;
+}
+
+/* Scans all members of the object in scope, hashing their keys into a table. If key_index can't grow 
+   (or the object lies beyond 4GB), index_mask stays 0 and keys are searched linearly instead */
+void xjson_build_key_index(xjson* json, xjson_scope* scope)
+{
+    uint8_t* saved_current = json->current;
+    uint32_t saved_cursor = json->tape_cursor;
+    uint32_t count = 0;
+    bool fits = true;
+
+    // First collect all the keys in a list
+    json->current = json->start + scope->begin;
+    while(!json->error && xjson_peek(json) == '\"')
+    {
+        size_t offset = json->current - json->start;
+        const uint8_t* key_start;
+        size_t key_len = xjson_skip_member(json, &key_start);
 
-        switch (type)
+        if(offset > UINT32_MAX || !fits || !xjson_reserve_key_index(json, count + 1))
         {
-        case XJSON_INT_TYPE_U8:
-            *(uint8_t*)val = (uint8_t)number;
-            break;
-        case XJSON_INT_TYPE_U16:
-            *(uint16_t*)val = (uint16_t)number;
-            break;
-        case XJSON_INT_TYPE_U32:
-            *(uint32_t*)val = (uint32_t)number;
-            break;
-        case XJSON_INT_TYPE_U64:
-            *(uint64_t*)val = (uint64_t)number;
-            break;
-        case XJSON_INT_TYPE_I8:
-            *(int8_t*)val = (int8_t)number;
-            break;
-        case XJSON_INT_TYPE_I16:
-            *(int16_t*)val = (int16_t)number;
-            break;
-        case XJSON_INT_TYPE_I32:
-            *(int32_t*)val = (int32_t)number;
-            break;
-        case XJSON_INT_TYPE_I64:
-            *(int64_t*)val = (int64_t)number;
-            break;
-        default:
-            // TODO: error
-            break;
+            fits = false;
         }
-        
-        xjson_try(json, ',');
-    }
-    else
-    {
-        if(key != NULL)
+        else
         {
-            if(json->pretty_print) xjson_print_new_line(json);
-            xjson_print_key(json, key);
+            xjson_key_slot* slot = json->key_index + json->key_index_top + count;
+            slot->offset = (uint32_t)offset;
+            slot->hash = xjson_hash_json_key(key_start, key_len);
         }
-        else if(json->pretty_print && xjson_lookback(json) != ':')
+        count++;
+    }
+
+    if(!json->error && xjson_peek(json) != '}')
+    {
+        xjson_error(json, "Unexpected token found.");
+    }
+    if(json->error) return;
+
+    scope->end = json->current - json->start;
+    scope->scanned = true;
+    json->current = saved_current;
+    json->tape_cursor = saved_cursor;
+
+    xjson_hash_key_index(json, scope, count, fits);
+}
+
+/* Looks up key in the current object and moves to it. hash is the key's hash if it's known already, otherwise NULL.
+   Returns false if the object doesn't contain the key */
+bool xjson_find_key(xjson* json, const char* key, size_t key_len, const uint32_t* key_hash)
+{
+    xjson_scope* scope = &json->scopes[json->intendation - 1];
+    if(!scope->scanned)
+    {
+        xjson_build_key_index(json, scope);
+        if(json->error) return false;
+    }
+
+    if(scope->index_mask != 0)
+    {
+        xjson_key_slot* table = json->key_index + scope->index_base;
+        uint32_t hash = key_hash != NULL ? *key_hash : xjson_hash_key(key, key_len);
+        for(uint32_t slot = hash & scope->index_mask; table[slot].offset != 0; slot = (slot + 1) & scope->index_mask)
         {
-            xjson_print_new_line(json);
+            if(table[slot].hash == hash && xjson_key_matches(json, table[slot].offset, key, key_len))
+            {
+                json->current = json->start + table[slot].offset;
+                return true;
+            }
         }
+        return false;
+    }
 
-        int len = 0;
-        switch (type)
+    // No hash table, walk all the members
+    uint8_t* saved_current = json->current;
+    json->current = json->start + scope->begin;
+    while(!json->error && xjson_peek(json) == '\"')
+    {
+        size_t offset = json->current - json->start;
+        if(xjson_key_matches(json, offset, key, key_len))
         {
-        case XJSON_INT_TYPE_U8:
-            len = sprintf((char*)json->current, "%" PRIu8, *(uint8_t*)val);
-            break;
-        case XJSON_INT_TYPE_U16:
-            len = sprintf((char*)json->current, "%" PRIu16, *(uint16_t*)val);
-            break;
-        case XJSON_INT_TYPE_U32:
-            len = sprintf((char*)json->current, "%" PRIu32, *(uint32_t*)val);
-            break;
-        case XJSON_INT_TYPE_U64:
-            len = sprintf((char*)json->current, "%" PRIu64, *(uint64_t*)val);
-            break;
-        case XJSON_INT_TYPE_I8:
-            len = sprintf((char*)json->current, "%" PRIi8, *(int8_t*)val);
-            break;
-        case XJSON_INT_TYPE_I16:
-            len = sprintf((char*)json->current, "%" PRIi16, *(int16_t*)val);
-            break;
-        case XJSON_INT_TYPE_I32:
-            len = sprintf((char*)json->current, "%" PRIi32, *(int32_t*)val);
-            break;
-        case XJSON_INT_TYPE_I64:
-            len = sprintf((char*)json->current, "%" PRIi64, *(int64_t*)val);
-            break;
-        default:
-            // TODO: error
-            break;
+            json->current = json->start + offset;
+            return true;
         }
-        json->current += len;
 
-        xjson_print_token(json, ",", 1);
+        const uint8_t* key_start;
+        xjson_skip_member(json, &key_start);
     }
-}
 
-void xjson_u8(xjson* json, const char* key, uint8_t* val)
-{
-    xjson_integer(json, key, val, XJSON_INT_TYPE_U8);
+    json->current = saved_current;
+    return false;
 }
 
-void xjson_u16(xjson* json, const char* key, uint16_t* val)
+/* Moves to the value of key in read mode. Keys may appear in any order, the next member is checked first. hash is 
+   the key's hash or NULL. Returns false if the value should not be read, because of an error or because the key is missing. */
+bool xjson_read_key_hashed(xjson* json, const char* key, size_t key_len, const uint32_t* hash)
 {
-    xjson_integer(json, key, val, XJSON_INT_TYPE_U16);
+    if(json->error || json->missing_depth > 0) return false;
+    if(key == NULL) return true;
+
+    if(xjson_peek(json) != '\"' || !xjson_key_matches(json, json->current - json->start, key, key_len))
+    {
+        if(json->intendation == 0 || json->scopes[json->intendation - 1].is_array)
+        {
+            xjson_error(json, "Expected key does not match.");
+            return false;
+        }
+
+        if(!xjson_find_key(json, key, key_len, hash)) return false;
+    }
+
+    xjson_expect_key(json, key, key_len);
+    XJSON_STATS_KEY(json);
+    return !json->error;
 }
 
-void xjson_u32(xjson* json, const char* key, uint32_t* val)
+bool xjson_read_key_len(xjson* json, const char* key, size_t key_len)
 {
-    xjson_integer(json, key, val, XJSON_INT_TYPE_U32);
+    return xjson_read_key_hashed(json, key, key_len, NULL);
 }
 
-void xjson_u64(xjson* json, const char* key, uint64_t* val)
+bool xjson_read_key(xjson* json, const char* key)
 {
-    xjson_integer(json, key, val, XJSON_INT_TYPE_U64);
+    return xjson_read_key_len(json, key, key != NULL ? strlen(key) : 0);
 }
 
-void xjson_i8(xjson* json, const char* key, int8_t* val)
+/* Opens a new object/array scope in read mode, current must be right after the opening bracket at bracket */
+void xjson_push_scope(xjson* json, const uint8_t* bracket, bool is_array)
 {
-    xjson_integer(json, key, val, XJSON_INT_TYPE_I8);
+    if(json->intendation >= XJSON_MAX_DEPTH)
+    {
+        xjson_error(json, "Maximum nesting depth exceeded.");
+        return;
+    }
+
+    xjson_scope* scope = &json->scopes[json->intendation];
+    scope->begin = json->current - json->start;
+    scope->end = 0;
+    scope->index_base = json->key_index_top;
+    scope->index_mask = 0;
+    scope->is_array = is_array;
+    scope->scanned = false;
+
+    xjson_tape_entry* entry = xjson_tape_find(json, bracket);
+    if(entry != NULL) scope->end = entry->match;
 }
 
-void xjson_i16(xjson* json, const char* key, int16_t* val)
+/* Moves to the closing bracket of the object in scope, skipping all members that haven't been read */
+void xjson_skip_members(xjson* json, xjson_scope* scope)
 {
-    xjson_integer(json, key, val, XJSON_INT_TYPE_I16);
+    // The closing bracket is known if the keys were indexed or the tape is used, otherwise skip member by member
+    if(scope->end != 0)
+    {
+        json->current = json->start + scope->end;
+        return;
+    }
+    while(!json->error && xjson_peek(json) == '\"')
+    {
+        const uint8_t* key_start;
+        xjson_skip_member(json, &key_start);
+    }
 }
 
-void xjson_i32(xjson* json, const char* key, int32_t* val)
+/* Checks whether 8 characters loaded into a (little-endian) uint64 are all digits */
+bool xjson_is_eight_digits(uint64_t chars)
 {
-    xjson_integer(json, key, val, XJSON_INT_TYPE_I32);
+    return ((chars & 0xF0F0F0F0F0F0F0F0ull) | (((chars + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull;
 }
 
-void xjson_i64(xjson* json, const char* key, int64_t* val)
+/* Converts 8 digit characters loaded into a (little-endian) uint64 with a few multiplications */
+uint32_t xjson_parse_eight_digits(uint64_t chars)
 {
-    xjson_integer(json, key, val, XJSON_INT_TYPE_I64);
+    const uint64_t mask = 0x000000FF000000FFull;
+    const uint64_t mul1 = 0x000F424000000064ull; // 100 + (1000000 << 32)
+    const uint64_t mul2 = 0x0000271000000001ull; // 1 + (10000 << 32)
+    chars -= 0x3030303030303030ull;
+    chars = (chars * 10) + (chars >> 8);
+    chars = (((chars & mask) * mul1) + (((chars >> 16) & mask) * mul2)) >> 32;
+    return (uint32_t)chars;
 }
 
-void xjson_float(xjson* json, const char* key, float* val)
+/* Parses an integer into its sign and magnitude. The magnitude covers the whole uint64 range, anything
+   larger is reported as an error. Range checks for the target type are up to the caller. */
+void xjson_expect_and_parse_int(xjson* json, uint64_t* out_magnitude, bool* out_negative)
 {
-    XJSON_ASSERT(json);
-    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+    if(json->error) return;
 
-    if(json->mode == XJSON_STATE_READ)
+    uint8_t* ptr = json->current;
+    bool negative = ptr < json->end && *ptr == '-';
+    if(negative) ptr++;
+
+    uint8_t* digits = ptr;
+    uint64_t value = 0;
+
+#if defined(XJSON_LITTLE_ENDIAN)
+    // Up to 19 digits can't overflow, take them 8 at a time while we can
+    while(ptr + 8 <= json->end && ptr - digits <= 11)
     {
-        if(key != NULL)
-        {
-            xjson_expect_key(json, key);
-        }
+        uint64_t chars;
+        memcpy(&chars, ptr, sizeof(chars));
+        if(!xjson_is_eight_digits(chars)) break;
 
-        double out;
-        xjson_expect_and_parse_double(json, &out);
-        if(!json->error)
-            *val = (float)out;
+        value = value * 100000000 + xjson_parse_eight_digits(chars);
+        ptr += 8;
+    }
+#endif
+    while(ptr < json->end && ptr - digits < 19 && (uint8_t)(*ptr - '0') <= 9)
+    {
+        value = value * 10 + (*ptr - '0');
+        ptr++;
+    }
 
-        xjson_try(json, ',');
+    if(ptr == digits)
+    {
+        // This means we couldn't parse the integer properly.
+        xjson_error(json, "Invalid integer found. Couldn't parse value.");
+        return;
     }
-    else
+
+    // The 20th digit may or may not fit into uint64, any more never do
+    if(ptr < json->end && (uint8_t)(*ptr - '0') <= 9)
     {
-        if(key != NULL)
+        uint64_t digit = *ptr - '0';
+        if(value > (UINT64_MAX - digit) / 10)
         {
-            if(json->pretty_print) xjson_print_new_line(json);
-            xjson_print_key(json, key);
+            xjson_error(json, "Integer value out of range.");
+            return;
         }
-        else if(json->pretty_print && xjson_lookback(json) != ':')
+        value = value * 10 + digit;
+        ptr++;
+
+        if(ptr < json->end && (uint8_t)(*ptr - '0') <= 9)
         {
-            xjson_print_new_line(json);
+            xjson_error(json, "Integer value out of range.");
+            return;
         }
+    }
+
+    json->current = ptr;
+    if(ptr < json->end && (*ptr == '.' || *ptr == 'e' || *ptr == 'E'))
+    {
+        xjson_error(json, "Expected an integer, found a floating-point value.");
+        return;
+    }
+
+    *out_magnitude = value;
+    *out_negative = negative;
+
+    // Move pointer to end of number value + ensure all white space is consumed
+    if(xjson_is_white_space(xjson_peek(json))){
+        xjson_consume(json);
+    }
+}
+
+//----------------------------------------------------------------------------------
+// Floating-point parsing
+//
+// A number is scanned into a significand of up to 19 digits and a power of ten. These are 
+// converted with the Eisel-Lemire algorithm, which gives the correctly rounded result using one or 
+// two 64x64 bit multiplications (see Lemire, "Number Parsing at a Gigabyte per Second"). Only if 
+// there were more than 19 significant digits and the dropped digits affect rounding, the exact but 
+// slow simple decimal conversion is used instead. Nothing here depends on the locale.
+//----------------------------------------------------------------------------------
+
+/* Describes the layout of a binary floating-point type */
+typedef struct xjson_float_format
+{
+    int mantissa_bits;
+    int minimum_exponent;
+    int infinite_power;
+    // Any value with a smaller/larger power of ten rounds to zero/infinity
+    int smallest_power_of_ten;
+    int largest_power_of_ten;
+    // Powers of ten for which a value can fall exactly between two floats
+    int min_round_to_even;
+    int max_round_to_even;
+} xjson_float_format;
+
+static const xjson_float_format xjson_double_format = { 52, -1023, 0x7FF, -342, 308, -4, 23 };
+static const xjson_float_format xjson_single_format = { 23, -127, 0xFF, -65, 38, -17, 10 };
+
+/* A binary floating-point value as mantissa and biased exponent, not including the sign */
+typedef struct xjson_adjusted_mantissa
+{
+    uint64_t mantissa;
+    int32_t power2;
+} xjson_adjusted_mantissa;
+
+/* A scanned json number, its value is significand * 10^exponent */
+typedef struct xjson_number
+{
+    uint64_t significand;
+    int64_t exponent;
+    bool negative;
+    // Set if there were more than 19 significant digits and some of the dropped ones weren't 0
+    bool truncated;
+    // The text of the number, needed for the exact fallback
+    uint8_t* start;
+    uint8_t* end;
+} xjson_number;
+
+#define XJSON_SMALLEST_POWER_OF_FIVE -342
+
+/* 5^q for q in [-342, 308], normalized and truncated to 128 bits. Stored as pairs of high and low 64 bits */
+static const uint64_t xjson_powers_of_five[] = {
+    0xeef453d6923bd65aull, 0x113faa2906a13b3full, 0x9558b4661b6565f8ull, 0x4ac7ca59a424c507ull,
+    0xbaaee17fa23ebf76ull, 0x5d79bcf00d2df649ull, 0xe95a99df8ace6f53ull, 0xf4d82c2c107973dcull,
+    0x91d8a02bb6c10594ull, 0x79071b9b8a4be869ull, 0xb64ec836a47146f9ull, 0x9748e2826cdee284ull,
+    0xe3e27a444d8d98b7ull, 0xfd1b1b2308169b25ull, 0x8e6d8c6ab0787f72ull, 0xfe30f0f5e50e20f7ull,
+    0xb208ef855c969f4full, 0xbdbd2d335e51a935ull, 0xde8b2b66b3bc4723ull, 0xad2c788035e61382ull,
+    0x8b16fb203055ac76ull, 0x4c3bcb5021afcc31ull, 0xaddcb9e83c6b1793ull, 0xdf4abe242a1bbf3dull,
+    0xd953e8624b85dd78ull, 0xd71d6dad34a2af0dull, 0x87d4713d6f33aa6bull, 0x8672648c40e5ad68ull,
+    0xa9c98d8ccb009506ull, 0x680efdaf511f18c2ull, 0xd43bf0effdc0ba48ull, 0x0212bd1b2566def2ull,
+    0x84a57695fe98746dull, 0x014bb630f7604b57ull, 0xa5ced43b7e3e9188ull, 0x419ea3bd35385e2dull,
+    0xcf42894a5dce35eaull, 0x52064cac828675b9ull, 0x818995ce7aa0e1b2ull, 0x7343efebd1940993ull,
+    0xa1ebfb4219491a1full, 0x1014ebe6c5f90bf8ull, 0xca66fa129f9b60a6ull, 0xd41a26e077774ef6ull,
+    0xfd00b897478238d0ull, 0x8920b098955522b4ull, 0x9e20735e8cb16382ull, 0x55b46e5f5d5535b0ull,
+    0xc5a890362fddbc62ull, 0xeb2189f734aa831dull, 0xf712b443bbd52b7bull, 0xa5e9ec7501d523e4ull,
+    0x9a6bb0aa55653b2dull, 0x47b233c92125366eull, 0xc1069cd4eabe89f8ull, 0x999ec0bb696e840aull,
+    0xf148440a256e2c76ull, 0xc00670ea43ca250dull, 0x96cd2a865764dbcaull, 0x380406926a5e5728ull,
+    0xbc807527ed3e12bcull, 0xc605083704f5ecf2ull, 0xeba09271e88d976bull, 0xf7864a44c633682eull,
+    0x93445b8731587ea3ull, 0x7ab3ee6afbe0211dull, 0xb8157268fdae9e4cull, 0x5960ea05bad82964ull,
+    0xe61acf033d1a45dfull, 0x6fb92487298e33bdull, 0x8fd0c16206306babull, 0xa5d3b6d479f8e056ull,
+    0xb3c4f1ba87bc8696ull, 0x8f48a4899877186cull, 0xe0b62e2929aba83cull, 0x331acdabfe94de87ull,
+    0x8c71dcd9ba0b4925ull, 0x9ff0c08b7f1d0b14ull, 0xaf8e5410288e1b6full, 0x07ecf0ae5ee44dd9ull,
+    0xdb71e91432b1a24aull, 0xc9e82cd9f69d6150ull, 0x892731ac9faf056eull, 0xbe311c083a225cd2ull,
+    0xab70fe17c79ac6caull, 0x6dbd630a48aaf406ull, 0xd64d3d9db981787dull, 0x092cbbccdad5b108ull,
+    0x85f0468293f0eb4eull, 0x25bbf56008c58ea5ull, 0xa76c582338ed2621ull, 0xaf2af2b80af6f24eull,
+    0xd1476e2c07286faaull, 0x1af5af660db4aee1ull, 0x82cca4db847945caull, 0x50d98d9fc890ed4dull,
+    0xa37fce126597973cull, 0xe50ff107bab528a0ull, 0xcc5fc196fefd7d0cull, 0x1e53ed49a96272c8ull,
+    0xff77b1fcbebcdc4full, 0x25e8e89c13bb0f7aull, 0x9faacf3df73609b1ull, 0x77b191618c54e9acull,
+    0xc795830d75038c1dull, 0xd59df5b9ef6a2417ull, 0xf97ae3d0d2446f25ull, 0x4b0573286b44ad1dull,
+    0x9becce62836ac577ull, 0x4ee367f9430aec32ull, 0xc2e801fb244576d5ull, 0x229c41f793cda73full,
+    0xf3a20279ed56d48aull, 0x6b43527578c1110full, 0x9845418c345644d6ull, 0x830a13896b78aaa9ull,
+    0xbe5691ef416bd60cull, 0x23cc986bc656d553ull, 0xedec366b11c6cb8full, 0x2cbfbe86b7ec8aa8ull,
+    0x94b3a202eb1c3f39ull, 0x7bf7d71432f3d6a9ull, 0xb9e08a83a5e34f07ull, 0xdaf5ccd93fb0cc53ull,
+    0xe858ad248f5c22c9ull, 0xd1b3400f8f9cff68ull, 0x91376c36d99995beull, 0x23100809b9c21fa1ull,
+    0xb58547448ffffb2dull, 0xabd40a0c2832a78aull, 0xe2e69915b3fff9f9ull, 0x16c90c8f323f516cull,
+    0x8dd01fad907ffc3bull, 0xae3da7d97f6792e3ull, 0xb1442798f49ffb4aull, 0x99cd11cfdf41779cull,
+    0xdd95317f31c7fa1dull, 0x40405643d711d583ull, 0x8a7d3eef7f1cfc52ull, 0x482835ea666b2572ull,
+    0xad1c8eab5ee43b66ull, 0xda3243650005eecfull, 0xd863b256369d4a40ull, 0x90bed43e40076a82ull,
+    0x873e4f75e2224e68ull, 0x5a7744a6e804a291ull, 0xa90de3535aaae202ull, 0x711515d0a205cb36ull,
+    0xd3515c2831559a83ull, 0x0d5a5b44ca873e03ull, 0x8412d9991ed58091ull, 0xe858790afe9486c2ull,
+    0xa5178fff668ae0b6ull, 0x626e974dbe39a872ull, 0xce5d73ff402d98e3ull, 0xfb0a3d212dc8128full,
+    0x80fa687f881c7f8eull, 0x7ce66634bc9d0b99ull, 0xa139029f6a239f72ull, 0x1c1fffc1ebc44e80ull,
+    0xc987434744ac874eull, 0xa327ffb266b56220ull, 0xfbe9141915d7a922ull, 0x4bf1ff9f0062baa8ull,
+    0x9d71ac8fada6c9b5ull, 0x6f773fc3603db4a9ull, 0xc4ce17b399107c22ull, 0xcb550fb4384d21d3ull,
+    0xf6019da07f549b2bull, 0x7e2a53a146606a48ull, 0x99c102844f94e0fbull, 0x2eda7444cbfc426dull,
+    0xc0314325637a1939ull, 0xfa911155fefb5308ull, 0xf03d93eebc589f88ull, 0x793555ab7eba27caull,
+    0x96267c7535b763b5ull, 0x4bc1558b2f3458deull, 0xbbb01b9283253ca2ull, 0x9eb1aaedfb016f16ull,
+    0xea9c227723ee8bcbull, 0x465e15a979c1cadcull, 0x92a1958a7675175full, 0x0bfacd89ec191ec9ull,
+    0xb749faed14125d36ull, 0xcef980ec671f667bull, 0xe51c79a85916f484ull, 0x82b7e12780e7401aull,
+    0x8f31cc0937ae58d2ull, 0xd1b2ecb8b0908810ull, 0xb2fe3f0b8599ef07ull, 0x861fa7e6dcb4aa15ull,
+    0xdfbdcece67006ac9ull, 0x67a791e093e1d49aull, 0x8bd6a141006042bdull, 0xe0c8bb2c5c6d24e0ull,
+    0xaecc49914078536dull, 0x58fae9f773886e18ull, 0xda7f5bf590966848ull, 0xaf39a475506a899eull,
+    0x888f99797a5e012dull, 0x6d8406c952429603ull, 0xaab37fd7d8f58178ull, 0xc8e5087ba6d33b83ull,
+    0xd5605fcdcf32e1d6ull, 0xfb1e4a9a90880a64ull, 0x855c3be0a17fcd26ull, 0x5cf2eea09a55067full,
+    0xa6b34ad8c9dfc06full, 0xf42faa48c0ea481eull, 0xd0601d8efc57b08bull, 0xf13b94daf124da26ull,
+    0x823c12795db6ce57ull, 0x76c53d08d6b70858ull, 0xa2cb1717b52481edull, 0x54768c4b0c64ca6eull,
+    0xcb7ddcdda26da268ull, 0xa9942f5dcf7dfd09ull, 0xfe5d54150b090b02ull, 0xd3f93b35435d7c4cull,
+    0x9efa548d26e5a6e1ull, 0xc47bc5014a1a6dafull, 0xc6b8e9b0709f109aull, 0x359ab6419ca1091bull,
+    0xf867241c8cc6d4c0ull, 0xc30163d203c94b62ull, 0x9b407691d7fc44f8ull, 0x79e0de63425dcf1dull,
+    0xc21094364dfb5636ull, 0x985915fc12f542e4ull, 0xf294b943e17a2bc4ull, 0x3e6f5b7b17b2939dull,
+    0x979cf3ca6cec5b5aull, 0xa705992ceecf9c42ull, 0xbd8430bd08277231ull, 0x50c6ff782a838353ull,
+    0xece53cec4a314ebdull, 0xa4f8bf5635246428ull, 0x940f4613ae5ed136ull, 0x871b7795e136be99ull,
+    0xb913179899f68584ull, 0x28e2557b59846e3full, 0xe757dd7ec07426e5ull, 0x331aeada2fe589cfull,
+    0x9096ea6f3848984full, 0x3ff0d2c85def7621ull, 0xb4bca50b065abe63ull, 0x0fed077a756b53a9ull,
+    0xe1ebce4dc7f16dfbull, 0xd3e8495912c62894ull, 0x8d3360f09cf6e4bdull, 0x64712dd7abbbd95cull,
+    0xb080392cc4349decull, 0xbd8d794d96aacfb3ull, 0xdca04777f541c567ull, 0xecf0d7a0fc5583a0ull,
+    0x89e42caaf9491b60ull, 0xf41686c49db57244ull, 0xac5d37d5b79b6239ull, 0x311c2875c522ced5ull,
+    0xd77485cb25823ac7ull, 0x7d633293366b828bull, 0x86a8d39ef77164bcull, 0xae5dff9c02033197ull,
+    0xa8530886b54dbdebull, 0xd9f57f830283fdfcull, 0xd267caa862a12d66ull, 0xd072df63c324fd7bull,
+    0x8380dea93da4bc60ull, 0x4247cb9e59f71e6dull, 0xa46116538d0deb78ull, 0x52d9be85f074e608ull,
+    0xcd795be870516656ull, 0x67902e276c921f8bull, 0x806bd9714632dff6ull, 0x00ba1cd8a3db53b6ull,
+    0xa086cfcd97bf97f3ull, 0x80e8a40eccd228a4ull, 0xc8a883c0fdaf7df0ull, 0x6122cd128006b2cdull,
+    0xfad2a4b13d1b5d6cull, 0x796b805720085f81ull, 0x9cc3a6eec6311a63ull, 0xcbe3303674053bb0ull,
+    0xc3f490aa77bd60fcull, 0xbedbfc4411068a9cull, 0xf4f1b4d515acb93bull, 0xee92fb5515482d44ull,
+    0x991711052d8bf3c5ull, 0x751bdd152d4d1c4aull, 0xbf5cd54678eef0b6ull, 0xd262d45a78a0635dull,
+    0xef340a98172aace4ull, 0x86fb897116c87c34ull, 0x9580869f0e7aac0eull, 0xd45d35e6ae3d4da0ull,
+    0xbae0a846d2195712ull, 0x8974836059cca109ull, 0xe998d258869facd7ull, 0x2bd1a438703fc94bull,
+    0x91ff83775423cc06ull, 0x7b6306a34627ddcfull, 0xb67f6455292cbf08ull, 0x1a3bc84c17b1d542ull,
+    0xe41f3d6a7377eecaull, 0x20caba5f1d9e4a93ull, 0x8e938662882af53eull, 0x547eb47b7282ee9cull,
+    0xb23867fb2a35b28dull, 0xe99e619a4f23aa43ull, 0xdec681f9f4c31f31ull, 0x6405fa00e2ec94d4ull,
+    0x8b3c113c38f9f37eull, 0xde83bc408dd3dd04ull, 0xae0b158b4738705eull, 0x9624ab50b148d445ull,
+    0xd98ddaee19068c76ull, 0x3badd624dd9b0957ull, 0x87f8a8d4cfa417c9ull, 0xe54ca5d70a80e5d6ull,
+    0xa9f6d30a038d1dbcull, 0x5e9fcf4ccd211f4cull, 0xd47487cc8470652bull, 0x7647c3200069671full,
+    0x84c8d4dfd2c63f3bull, 0x29ecd9f40041e073ull, 0xa5fb0a17c777cf09ull, 0xf468107100525890ull,
+    0xcf79cc9db955c2ccull, 0x7182148d4066eeb4ull, 0x81ac1fe293d599bfull, 0xc6f14cd848405530ull,
+    0xa21727db38cb002full, 0xb8ada00e5a506a7cull, 0xca9cf1d206fdc03bull, 0xa6d90811f0e4851cull,
+    0xfd442e4688bd304aull, 0x908f4a166d1da663ull, 0x9e4a9cec15763e2eull, 0x9a598e4e043287feull,
+    0xc5dd44271ad3cdbaull, 0x40eff1e1853f29fdull, 0xf7549530e188c128ull, 0xd12bee59e68ef47cull,
+    0x9a94dd3e8cf578b9ull, 0x82bb74f8301958ceull, 0xc13a148e3032d6e7ull, 0xe36a52363c1faf01ull,
+    0xf18899b1bc3f8ca1ull, 0xdc44e6c3cb279ac1ull, 0x96f5600f15a7b7e5ull, 0x29ab103a5ef8c0b9ull,
+    0xbcb2b812db11a5deull, 0x7415d448f6b6f0e7ull, 0xebdf661791d60f56ull, 0x111b495b3464ad21ull,
+    0x936b9fcebb25c995ull, 0xcab10dd900beec34ull, 0xb84687c269ef3bfbull, 0x3d5d514f40eea742ull,
+    0xe65829b3046b0afaull, 0x0cb4a5a3112a5112ull, 0x8ff71a0fe2c2e6dcull, 0x47f0e785eaba72abull,
+    0xb3f4e093db73a093ull, 0x59ed216765690f56ull, 0xe0f218b8d25088b8ull, 0x306869c13ec3532cull,
+    0x8c974f7383725573ull, 0x1e414218c73a13fbull, 0xafbd2350644eeacfull, 0xe5d1929ef90898faull,
+    0xdbac6c247d62a583ull, 0xdf45f746b74abf39ull, 0x894bc396ce5da772ull, 0x6b8bba8c328eb783ull,
+    0xab9eb47c81f5114full, 0x066ea92f3f326564ull, 0xd686619ba27255a2ull, 0xc80a537b0efefebdull,
+    0x8613fd0145877585ull, 0xbd06742ce95f5f36ull, 0xa798fc4196e952e7ull, 0x2c48113823b73704ull,
+    0xd17f3b51fca3a7a0ull, 0xf75a15862ca504c5ull, 0x82ef85133de648c4ull, 0x9a984d73dbe722fbull,
+    0xa3ab66580d5fdaf5ull, 0xc13e60d0d2e0ebbaull, 0xcc963fee10b7d1b3ull, 0x318df905079926a8ull,
+    0xffbbcfe994e5c61full, 0xfdf17746497f7052ull, 0x9fd561f1fd0f9bd3ull, 0xfeb6ea8bedefa633ull,
+    0xc7caba6e7c5382c8ull, 0xfe64a52ee96b8fc0ull, 0xf9bd690a1b68637bull, 0x3dfdce7aa3c673b0ull,
+    0x9c1661a651213e2dull, 0x06bea10ca65c084eull, 0xc31bfa0fe5698db8ull, 0x486e494fcff30a62ull,
+    0xf3e2f893dec3f126ull, 0x5a89dba3c3efccfaull, 0x986ddb5c6b3a76b7ull, 0xf89629465a75e01cull,
+    0xbe89523386091465ull, 0xf6bbb397f1135823ull, 0xee2ba6c0678b597full, 0x746aa07ded582e2cull,
+    0x94db483840b717efull, 0xa8c2a44eb4571cdcull, 0xba121a4650e4ddebull, 0x92f34d62616ce413ull,
+    0xe896a0d7e51e1566ull, 0x77b020baf9c81d17ull, 0x915e2486ef32cd60ull, 0x0ace1474dc1d122eull,
+    0xb5b5ada8aaff80b8ull, 0x0d819992132456baull, 0xe3231912d5bf60e6ull, 0x10e1fff697ed6c69ull,
+    0x8df5efabc5979c8full, 0xca8d3ffa1ef463c1ull, 0xb1736b96b6fd83b3ull, 0xbd308ff8a6b17cb2ull,
+    0xddd0467c64bce4a0ull, 0xac7cb3f6d05ddbdeull, 0x8aa22c0dbef60ee4ull, 0x6bcdf07a423aa96bull,
+    0xad4ab7112eb3929dull, 0x86c16c98d2c953c6ull, 0xd89d64d57a607744ull, 0xe871c7bf077ba8b7ull,
+    0x87625f056c7c4a8bull, 0x11471cd764ad4972ull, 0xa93af6c6c79b5d2dull, 0xd598e40d3dd89bcfull,
+    0xd389b47879823479ull, 0x4aff1d108d4ec2c3ull, 0x843610cb4bf160cbull, 0xcedf722a585139baull,
+    0xa54394fe1eedb8feull, 0xc2974eb4ee658828ull, 0xce947a3da6a9273eull, 0x733d226229feea32ull,
+    0x811ccc668829b887ull, 0x0806357d5a3f525full, 0xa163ff802a3426a8ull, 0xca07c2dcb0cf26f7ull,
+    0xc9bcff6034c13052ull, 0xfc89b393dd02f0b5ull, 0xfc2c3f3841f17c67ull, 0xbbac2078d443ace2ull,
+    0x9d9ba7832936edc0ull, 0xd54b944b84aa4c0dull, 0xc5029163f384a931ull, 0x0a9e795e65d4df11ull,
+    0xf64335bcf065d37dull, 0x4d4617b5ff4a16d5ull, 0x99ea0196163fa42eull, 0x504bced1bf8e4e45ull,
+    0xc06481fb9bcf8d39ull, 0xe45ec2862f71e1d6ull, 0xf07da27a82c37088ull, 0x5d767327bb4e5a4cull,
+    0x964e858c91ba2655ull, 0x3a6a07f8d510f86full, 0xbbe226efb628afeaull, 0x890489f70a55368bull,
+    0xeadab0aba3b2dbe5ull, 0x2b45ac74ccea842eull, 0x92c8ae6b464fc96full, 0x3b0b8bc90012929dull,
+    0xb77ada0617e3bbcbull, 0x09ce6ebb40173744ull, 0xe55990879ddcaabdull, 0xcc420a6a101d0515ull,
+    0x8f57fa54c2a9eab6ull, 0x9fa946824a12232dull, 0xb32df8e9f3546564ull, 0x47939822dc96abf9ull,
+    0xdff9772470297ebdull, 0x59787e2b93bc56f7ull, 0x8bfbea76c619ef36ull, 0x57eb4edb3c55b65aull,
+    0xaefae51477a06b03ull, 0xede622920b6b23f1ull, 0xdab99e59958885c4ull, 0xe95fab368e45ecedull,
+    0x88b402f7fd75539bull, 0x11dbcb0218ebb414ull, 0xaae103b5fcd2a881ull, 0xd652bdc29f26a119ull,
+    0xd59944a37c0752a2ull, 0x4be76d3346f0495full, 0x857fcae62d8493a5ull, 0x6f70a4400c562ddbull,
+    0xa6dfbd9fb8e5b88eull, 0xcb4ccd500f6bb952ull, 0xd097ad07a71f26b2ull, 0x7e2000a41346a7a7ull,
+    0x825ecc24c873782full, 0x8ed400668c0c28c8ull, 0xa2f67f2dfa90563bull, 0x728900802f0f32faull,
+    0xcbb41ef979346bcaull, 0x4f2b40a03ad2ffb9ull, 0xfea126b7d78186bcull, 0xe2f610c84987bfa8ull,
+    0x9f24b832e6b0f436ull, 0x0dd9ca7d2df4d7c9ull, 0xc6ede63fa05d3143ull, 0x91503d1c79720dbbull,
+    0xf8a95fcf88747d94ull, 0x75a44c6397ce912aull, 0x9b69dbe1b548ce7cull, 0xc986afbe3ee11abaull,
+    0xc24452da229b021bull, 0xfbe85badce996168ull, 0xf2d56790ab41c2a2ull, 0xfae27299423fb9c3ull,
+    0x97c560ba6b0919a5ull, 0xdccd879fc967d41aull, 0xbdb6b8e905cb600full, 0x5400e987bbc1c920ull,
+    0xed246723473e3813ull, 0x290123e9aab23b68ull, 0x9436c0760c86e30bull, 0xf9a0b6720aaf6521ull,
+    0xb94470938fa89bceull, 0xf808e40e8d5b3e69ull, 0xe7958cb87392c2c2ull, 0xb60b1d1230b20e04ull,
+    0x90bd77f3483bb9b9ull, 0xb1c6f22b5e6f48c2ull, 0xb4ecd5f01a4aa828ull, 0x1e38aeb6360b1af3ull,
+    0xe2280b6c20dd5232ull, 0x25c6da63c38de1b0ull, 0x8d590723948a535full, 0x579c487e5a38ad0eull,
+    0xb0af48ec79ace837ull, 0x2d835a9df0c6d851ull, 0xdcdb1b2798182244ull, 0xf8e431456cf88e65ull,
+    0x8a08f0f8bf0f156bull, 0x1b8e9ecb641b58ffull, 0xac8b2d36eed2dac5ull, 0xe272467e3d222f3full,
+    0xd7adf884aa879177ull, 0x5b0ed81dcc6abb0full, 0x86ccbb52ea94baeaull, 0x98e947129fc2b4e9ull,
+    0xa87fea27a539e9a5ull, 0x3f2398d747b36224ull, 0xd29fe4b18e88640eull, 0x8eec7f0d19a03aadull,
+    0x83a3eeeef9153e89ull, 0x1953cf68300424acull, 0xa48ceaaab75a8e2bull, 0x5fa8c3423c052dd7ull,
+    0xcdb02555653131b6ull, 0x3792f412cb06794dull, 0x808e17555f3ebf11ull, 0xe2bbd88bbee40bd0ull,
+    0xa0b19d2ab70e6ed6ull, 0x5b6aceaeae9d0ec4ull, 0xc8de047564d20a8bull, 0xf245825a5a445275ull,
+    0xfb158592be068d2eull, 0xeed6e2f0f0d56712ull, 0x9ced737bb6c4183dull, 0x55464dd69685606bull,
+    0xc428d05aa4751e4cull, 0xaa97e14c3c26b886ull, 0xf53304714d9265dfull, 0xd53dd99f4b3066a8ull,
+    0x993fe2c6d07b7fabull, 0xe546a8038efe4029ull, 0xbf8fdb78849a5f96ull, 0xde98520472bdd033ull,
+    0xef73d256a5c0f77cull, 0x963e66858f6d4440ull, 0x95a8637627989aadull, 0xdde7001379a44aa8ull,
+    0xbb127c53b17ec159ull, 0x5560c018580d5d52ull, 0xe9d71b689dde71afull, 0xaab8f01e6e10b4a6ull,
+    0x9226712162ab070dull, 0xcab3961304ca70e8ull, 0xb6b00d69bb55c8d1ull, 0x3d607b97c5fd0d22ull,
+    0xe45c10c42a2b3b05ull, 0x8cb89a7db77c506aull, 0x8eb98a7a9a5b04e3ull, 0x77f3608e92adb242ull,
+    0xb267ed1940f1c61cull, 0x55f038b237591ed3ull, 0xdf01e85f912e37a3ull, 0x6b6c46dec52f6688ull,
+    0x8b61313bbabce2c6ull, 0x2323ac4b3b3da015ull, 0xae397d8aa96c1b77ull, 0xabec975e0a0d081aull,
+    0xd9c7dced53c72255ull, 0x96e7bd358c904a21ull, 0x881cea14545c7575ull, 0x7e50d64177da2e54ull,
+    0xaa242499697392d2ull, 0xdde50bd1d5d0b9e9ull, 0xd4ad2dbfc3d07787ull, 0x955e4ec64b44e864ull,
+    0x84ec3c97da624ab4ull, 0xbd5af13bef0b113eull, 0xa6274bbdd0fadd61ull, 0xecb1ad8aeacdd58eull,
+    0xcfb11ead453994baull, 0x67de18eda5814af2ull, 0x81ceb32c4b43fcf4ull, 0x80eacf948770ced7ull,
+    0xa2425ff75e14fc31ull, 0xa1258379a94d028dull, 0xcad2f7f5359a3b3eull, 0x096ee45813a04330ull,
+    0xfd87b5f28300ca0dull, 0x8bca9d6e188853fcull, 0x9e74d1b791e07e48ull, 0x775ea264cf55347eull,
+    0xc612062576589ddaull, 0x95364afe032a819eull, 0xf79687aed3eec551ull, 0x3a83ddbd83f52205ull,
+    0x9abe14cd44753b52ull, 0xc4926a9672793543ull, 0xc16d9a0095928a27ull, 0x75b7053c0f178294ull,
+    0xf1c90080baf72cb1ull, 0x5324c68b12dd6339ull, 0x971da05074da7beeull, 0xd3f6fc16ebca5e04ull,
+    0xbce5086492111aeaull, 0x88f4bb1ca6bcf585ull, 0xec1e4a7db69561a5ull, 0x2b31e9e3d06c32e6ull,
+    0x9392ee8e921d5d07ull, 0x3aff322e62439fd0ull, 0xb877aa3236a4b449ull, 0x09befeb9fad487c3ull,
+    0xe69594bec44de15bull, 0x4c2ebe687989a9b4ull, 0x901d7cf73ab0acd9ull, 0x0f9d37014bf60a11ull,
+    0xb424dc35095cd80full, 0x538484c19ef38c95ull, 0xe12e13424bb40e13ull, 0x2865a5f206b06fbaull,
+    0x8cbccc096f5088cbull, 0xf93f87b7442e45d4ull, 0xafebff0bcb24aafeull, 0xf78f69a51539d749ull,
+    0xdbe6fecebdedd5beull, 0xb573440e5a884d1cull, 0x89705f4136b4a597ull, 0x31680a88f8953031ull,
+    0xabcc77118461cefcull, 0xfdc20d2b36ba7c3eull, 0xd6bf94d5e57a42bcull, 0x3d32907604691b4dull,
+    0x8637bd05af6c69b5ull, 0xa63f9a49c2c1b110ull, 0xa7c5ac471b478423ull, 0x0fcf80dc33721d54ull,
+    0xd1b71758e219652bull, 0xd3c36113404ea4a9ull, 0x83126e978d4fdf3bull, 0x645a1cac083126eaull,
+    0xa3d70a3d70a3d70aull, 0x3d70a3d70a3d70a4ull, 0xccccccccccccccccull, 0xcccccccccccccccdull,
+    0x8000000000000000ull, 0x0000000000000000ull, 0xa000000000000000ull, 0x0000000000000000ull,
+    0xc800000000000000ull, 0x0000000000000000ull, 0xfa00000000000000ull, 0x0000000000000000ull,
+    0x9c40000000000000ull, 0x0000000000000000ull, 0xc350000000000000ull, 0x0000000000000000ull,
+    0xf424000000000000ull, 0x0000000000000000ull, 0x9896800000000000ull, 0x0000000000000000ull,
+    0xbebc200000000000ull, 0x0000000000000000ull, 0xee6b280000000000ull, 0x0000000000000000ull,
+    0x9502f90000000000ull, 0x0000000000000000ull, 0xba43b74000000000ull, 0x0000000000000000ull,
+    0xe8d4a51000000000ull, 0x0000000000000000ull, 0x9184e72a00000000ull, 0x0000000000000000ull,
+    0xb5e620f480000000ull, 0x0000000000000000ull, 0xe35fa931a0000000ull, 0x0000000000000000ull,
+    0x8e1bc9bf04000000ull, 0x0000000000000000ull, 0xb1a2bc2ec5000000ull, 0x0000000000000000ull,
+    0xde0b6b3a76400000ull, 0x0000000000000000ull, 0x8ac7230489e80000ull, 0x0000000000000000ull,
+    0xad78ebc5ac620000ull, 0x0000000000000000ull, 0xd8d726b7177a8000ull, 0x0000000000000000ull,
+    0x878678326eac9000ull, 0x0000000000000000ull, 0xa968163f0a57b400ull, 0x0000000000000000ull,
+    0xd3c21bcecceda100ull, 0x0000000000000000ull, 0x84595161401484a0ull, 0x0000000000000000ull,
+    0xa56fa5b99019a5c8ull, 0x0000000000000000ull, 0xcecb8f27f4200f3aull, 0x0000000000000000ull,
+    0x813f3978f8940984ull, 0x4000000000000000ull, 0xa18f07d736b90be5ull, 0x5000000000000000ull,
+    0xc9f2c9cd04674edeull, 0xa400000000000000ull, 0xfc6f7c4045812296ull, 0x4d00000000000000ull,
+    0x9dc5ada82b70b59dull, 0xf020000000000000ull, 0xc5371912364ce305ull, 0x6c28000000000000ull,
+    0xf684df56c3e01bc6ull, 0xc732000000000000ull, 0x9a130b963a6c115cull, 0x3c7f400000000000ull,
+    0xc097ce7bc90715b3ull, 0x4b9f100000000000ull, 0xf0bdc21abb48db20ull, 0x1e86d40000000000ull,
+    0x96769950b50d88f4ull, 0x1314448000000000ull, 0xbc143fa4e250eb31ull, 0x17d955a000000000ull,
+    0xeb194f8e1ae525fdull, 0x5dcfab0800000000ull, 0x92efd1b8d0cf37beull, 0x5aa1cae500000000ull,
+    0xb7abc627050305adull, 0xf14a3d9e40000000ull, 0xe596b7b0c643c719ull, 0x6d9ccd05d0000000ull,
+    0x8f7e32ce7bea5c6full, 0xe4820023a2000000ull, 0xb35dbf821ae4f38bull, 0xdda2802c8a800000ull,
+    0xe0352f62a19e306eull, 0xd50b2037ad200000ull, 0x8c213d9da502de45ull, 0x4526f422cc340000ull,
+    0xaf298d050e4395d6ull, 0x9670b12b7f410000ull, 0xdaf3f04651d47b4cull, 0x3c0cdd765f114000ull,
+    0x88d8762bf324cd0full, 0xa5880a69fb6ac800ull, 0xab0e93b6efee0053ull, 0x8eea0d047a457a00ull,
+    0xd5d238a4abe98068ull, 0x72a4904598d6d880ull, 0x85a36366eb71f041ull, 0x47a6da2b7f864750ull,
+    0xa70c3c40a64e6c51ull, 0x999090b65f67d924ull, 0xd0cf4b50cfe20765ull, 0xfff4b4e3f741cf6dull,
+    0x82818f1281ed449full, 0xbff8f10e7a8921a4ull, 0xa321f2d7226895c7ull, 0xaff72d52192b6a0dull,
+    0xcbea6f8ceb02bb39ull, 0x9bf4f8a69f764490ull, 0xfee50b7025c36a08ull, 0x02f236d04753d5b4ull,
+    0x9f4f2726179a2245ull, 0x01d762422c946590ull, 0xc722f0ef9d80aad6ull, 0x424d3ad2b7b97ef5ull,
+    0xf8ebad2b84e0d58bull, 0xd2e0898765a7deb2ull, 0x9b934c3b330c8577ull, 0x63cc55f49f88eb2full,
+    0xc2781f49ffcfa6d5ull, 0x3cbf6b71c76b25fbull, 0xf316271c7fc3908aull, 0x8bef464e3945ef7aull,
+    0x97edd871cfda3a56ull, 0x97758bf0e3cbb5acull, 0xbde94e8e43d0c8ecull, 0x3d52eeed1cbea317ull,
+    0xed63a231d4c4fb27ull, 0x4ca7aaa863ee4bddull, 0x945e455f24fb1cf8ull, 0x8fe8caa93e74ef6aull,
+    0xb975d6b6ee39e436ull, 0xb3e2fd538e122b44ull, 0xe7d34c64a9c85d44ull, 0x60dbbca87196b616ull,
+    0x90e40fbeea1d3a4aull, 0xbc8955e946fe31cdull, 0xb51d13aea4a488ddull, 0x6babab6398bdbe41ull,
+    0xe264589a4dcdab14ull, 0xc696963c7eed2dd1ull, 0x8d7eb76070a08aecull, 0xfc1e1de5cf543ca2ull,
+    0xb0de65388cc8ada8ull, 0x3b25a55f43294bcbull, 0xdd15fe86affad912ull, 0x49ef0eb713f39ebeull,
+    0x8a2dbf142dfcc7abull, 0x6e3569326c784337ull, 0xacb92ed9397bf996ull, 0x49c2c37f07965404ull,
+    0xd7e77a8f87daf7fbull, 0xdc33745ec97be906ull, 0x86f0ac99b4e8dafdull, 0x69a028bb3ded71a3ull,
+    0xa8acd7c0222311bcull, 0xc40832ea0d68ce0cull, 0xd2d80db02aabd62bull, 0xf50a3fa490c30190ull,
+    0x83c7088e1aab65dbull, 0x792667c6da79e0faull, 0xa4b8cab1a1563f52ull, 0x577001b891185938ull,
+    0xcde6fd5e09abcf26ull, 0xed4c0226b55e6f86ull, 0x80b05e5ac60b6178ull, 0x544f8158315b05b4ull,
+    0xa0dc75f1778e39d6ull, 0x696361ae3db1c721ull, 0xc913936dd571c84cull, 0x03bc3a19cd1e38e9ull,
+    0xfb5878494ace3a5full, 0x04ab48a04065c723ull, 0x9d174b2dcec0e47bull, 0x62eb0d64283f9c76ull,
+    0xc45d1df942711d9aull, 0x3ba5d0bd324f8394ull, 0xf5746577930d6500ull, 0xca8f44ec7ee36479ull,
+    0x9968bf6abbe85f20ull, 0x7e998b13cf4e1ecbull, 0xbfc2ef456ae276e8ull, 0x9e3fedd8c321a67eull,
+    0xefb3ab16c59b14a2ull, 0xc5cfe94ef3ea101eull, 0x95d04aee3b80ece5ull, 0xbba1f1d158724a12ull,
+    0xbb445da9ca61281full, 0x2a8a6e45ae8edc97ull, 0xea1575143cf97226ull, 0xf52d09d71a3293bdull,
+    0x924d692ca61be758ull, 0x593c2626705f9c56ull, 0xb6e0c377cfa2e12eull, 0x6f8b2fb00c77836cull,
+    0xe498f455c38b997aull, 0x0b6dfb9c0f956447ull, 0x8edf98b59a373fecull, 0x4724bd4189bd5eacull,
+    0xb2977ee300c50fe7ull, 0x58edec91ec2cb657ull, 0xdf3d5e9bc0f653e1ull, 0x2f2967b66737e3edull,
+    0x8b865b215899f46cull, 0xbd79e0d20082ee74ull, 0xae67f1e9aec07187ull, 0xecd8590680a3aa11ull,
+    0xda01ee641a708de9ull, 0xe80e6f4820cc9495ull, 0x884134fe908658b2ull, 0x3109058d147fdcddull,
+    0xaa51823e34a7eedeull, 0xbd4b46f0599fd415ull, 0xd4e5e2cdc1d1ea96ull, 0x6c9e18ac7007c91aull,
+    0x850fadc09923329eull, 0x03e2cf6bc604ddb0ull, 0xa6539930bf6bff45ull, 0x84db8346b786151cull,
+    0xcfe87f7cef46ff16ull, 0xe612641865679a63ull, 0x81f14fae158c5f6eull, 0x4fcb7e8f3f60c07eull,
+    0xa26da3999aef7749ull, 0xe3be5e330f38f09dull, 0xcb090c8001ab551cull, 0x5cadf5bfd3072cc5ull,
+    0xfdcb4fa002162a63ull, 0x73d9732fc7c8f7f6ull, 0x9e9f11c4014dda7eull, 0x2867e7fddcdd9afaull,
+    0xc646d63501a1511dull, 0xb281e1fd541501b8ull, 0xf7d88bc24209a565ull, 0x1f225a7ca91a4226ull,
+    0x9ae757596946075full, 0x3375788de9b06958ull, 0xc1a12d2fc3978937ull, 0x0052d6b1641c83aeull,
+    0xf209787bb47d6b84ull, 0xc0678c5dbd23a49aull, 0x9745eb4d50ce6332ull, 0xf840b7ba963646e0ull,
+    0xbd176620a501fbffull, 0xb650e5a93bc3d898ull, 0xec5d3fa8ce427affull, 0xa3e51f138ab4cebeull,
+    0x93ba47c980e98cdfull, 0xc66f336c36b10137ull, 0xb8a8d9bbe123f017ull, 0xb80b0047445d4184ull,
+    0xe6d3102ad96cec1dull, 0xa60dc059157491e5ull, 0x9043ea1ac7e41392ull, 0x87c89837ad68db2full,
+    0xb454e4a179dd1877ull, 0x29babe4598c311fbull, 0xe16a1dc9d8545e94ull, 0xf4296dd6fef3d67aull,
+    0x8ce2529e2734bb1dull, 0x1899e4a65f58660cull, 0xb01ae745b101e9e4ull, 0x5ec05dcff72e7f8full,
+    0xdc21a1171d42645dull, 0x76707543f4fa1f73ull, 0x899504ae72497ebaull, 0x6a06494a791c53a8ull,
+    0xabfa45da0edbde69ull, 0x0487db9d17636892ull, 0xd6f8d7509292d603ull, 0x45a9d2845d3c42b6ull,
+    0x865b86925b9bc5c2ull, 0x0b8a2392ba45a9b2ull, 0xa7f26836f282b732ull, 0x8e6cac7768d7141eull,
+    0xd1ef0244af2364ffull, 0x3207d795430cd926ull, 0x8335616aed761f1full, 0x7f44e6bd49e807b8ull,
+    0xa402b9c5a8d3a6e7ull, 0x5f16206c9c6209a6ull, 0xcd036837130890a1ull, 0x36dba887c37a8c0full,
+    0x802221226be55a64ull, 0xc2494954da2c9789ull, 0xa02aa96b06deb0fdull, 0xf2db9baa10b7bd6cull,
+    0xc83553c5c8965d3dull, 0x6f92829494e5acc7ull, 0xfa42a8b73abbf48cull, 0xcb772339ba1f17f9ull,
+    0x9c69a97284b578d7ull, 0xff2a760414536efbull, 0xc38413cf25e2d70dull, 0xfef5138519684abaull,
+    0xf46518c2ef5b8cd1ull, 0x7eb258665fc25d69ull, 0x98bf2f79d5993802ull, 0xef2f773ffbd97a61ull,
+    0xbeeefb584aff8603ull, 0xaafb550ffacfd8faull, 0xeeaaba2e5dbf6784ull, 0x95ba2a53f983cf38ull,
+    0x952ab45cfa97a0b2ull, 0xdd945a747bf26183ull, 0xba756174393d88dfull, 0x94f971119aeef9e4ull,
+    0xe912b9d1478ceb17ull, 0x7a37cd5601aab85dull, 0x91abb422ccb812eeull, 0xac62e055c10ab33aull,
+    0xb616a12b7fe617aaull, 0x577b986b314d6009ull, 0xe39c49765fdf9d94ull, 0xed5a7e85fda0b80bull,
+    0x8e41ade9fbebc27dull, 0x14588f13be847307ull, 0xb1d219647ae6b31cull, 0x596eb2d8ae258fc8ull,
+    0xde469fbd99a05fe3ull, 0x6fca5f8ed9aef3bbull, 0x8aec23d680043beeull, 0x25de7bb9480d5854ull,
+    0xada72ccc20054ae9ull, 0xaf561aa79a10ae6aull, 0xd910f7ff28069da4ull, 0x1b2ba1518094da04ull,
+    0x87aa9aff79042286ull, 0x90fb44d2f05d0842ull, 0xa99541bf57452b28ull, 0x353a1607ac744a53ull,
+    0xd3fa922f2d1675f2ull, 0x42889b8997915ce8ull, 0x847c9b5d7c2e09b7ull, 0x69956135febada11ull,
+    0xa59bc234db398c25ull, 0x43fab9837e699095ull, 0xcf02b2c21207ef2eull, 0x94f967e45e03f4bbull,
+    0x8161afb94b44f57dull, 0x1d1be0eebac278f5ull, 0xa1ba1ba79e1632dcull, 0x6462d92a69731732ull,
+    0xca28a291859bbf93ull, 0x7d7b8f7503cfdcfeull, 0xfcb2cb35e702af78ull, 0x5cda735244c3d43eull,
+    0x9defbf01b061adabull, 0x3a0888136afa64a7ull, 0xc56baec21c7a1916ull, 0x088aaa1845b8fdd0ull,
+    0xf6c69a72a3989f5bull, 0x8aad549e57273d45ull, 0x9a3c2087a63f6399ull, 0x36ac54e2f678864bull,
+    0xc0cb28a98fcf3c7full, 0x84576a1bb416a7ddull, 0xf0fdf2d3f3c30b9full, 0x656d44a2a11c51d5ull,
+    0x969eb7c47859e743ull, 0x9f644ae5a4b1b325ull, 0xbc4665b596706114ull, 0x873d5d9f0dde1feeull,
+    0xeb57ff22fc0c7959ull, 0xa90cb506d155a7eaull, 0x9316ff75dd87cbd8ull, 0x09a7f12442d588f2ull,
+    0xb7dcbf5354e9beceull, 0x0c11ed6d538aeb2full, 0xe5d3ef282a242e81ull, 0x8f1668c8a86da5faull,
+    0x8fa475791a569d10ull, 0xf96e017d694487bcull, 0xb38d92d760ec4455ull, 0x37c981dcc395a9acull,
+    0xe070f78d3927556aull, 0x85bbe253f47b1417ull, 0x8c469ab843b89562ull, 0x93956d7478ccec8eull,
+    0xaf58416654a6babbull, 0x387ac8d1970027b2ull, 0xdb2e51bfe9d0696aull, 0x06997b05fcc0319eull,
+    0x88fcf317f22241e2ull, 0x441fece3bdf81f03ull, 0xab3c2fddeeaad25aull, 0xd527e81cad7626c3ull,
+    0xd60b3bd56a5586f1ull, 0x8a71e223d8d3b074ull, 0x85c7056562757456ull, 0xf6872d5667844e49ull,
+    0xa738c6bebb12d16cull, 0xb428f8ac016561dbull, 0xd106f86e69d785c7ull, 0xe13336d701beba52ull,
+    0x82a45b450226b39cull, 0xecc0024661173473ull, 0xa34d721642b06084ull, 0x27f002d7f95d0190ull,
+    0xcc20ce9bd35c78a5ull, 0x31ec038df7b441f4ull, 0xff290242c83396ceull, 0x7e67047175a15271ull,
+    0x9f79a169bd203e41ull, 0x0f0062c6e984d386ull, 0xc75809c42c684dd1ull, 0x52c07b78a3e60868ull,
+    0xf92e0c3537826145ull, 0xa7709a56ccdf8a82ull, 0x9bbcc7a142b17ccbull, 0x88a66076400bb691ull,
+    0xc2abf989935ddbfeull, 0x6acff893d00ea435ull, 0xf356f7ebf83552feull, 0x0583f6b8c4124d43ull,
+    0x98165af37b2153deull, 0xc3727a337a8b704aull, 0xbe1bf1b059e9a8d6ull, 0x744f18c0592e4c5cull,
+    0xeda2ee1c7064130cull, 0x1162def06f79df73ull, 0x9485d4d1c63e8be7ull, 0x8addcb5645ac2ba8ull,
+    0xb9a74a0637ce2ee1ull, 0x6d953e2bd7173692ull, 0xe8111c87c5c1ba99ull, 0xc8fa8db6ccdd0437ull,
+    0x910ab1d4db9914a0ull, 0x1d9c9892400a22a2ull, 0xb54d5e4a127f59c8ull, 0x2503beb6d00cab4bull,
+    0xe2a0b5dc971f303aull, 0x2e44ae64840fd61dull, 0x8da471a9de737e24ull, 0x5ceaecfed289e5d2ull,
+    0xb10d8e1456105dadull, 0x7425a83e872c5f47ull, 0xdd50f1996b947518ull, 0xd12f124e28f77719ull,
+    0x8a5296ffe33cc92full, 0x82bd6b70d99aaa6full, 0xace73cbfdc0bfb7bull, 0x636cc64d1001550bull,
+    0xd8210befd30efa5aull, 0x3c47f7e05401aa4eull, 0x8714a775e3e95c78ull, 0x65acfaec34810a71ull,
+    0xa8d9d1535ce3b396ull, 0x7f1839a741a14d0dull, 0xd31045a8341ca07cull, 0x1ede48111209a050ull,
+    0x83ea2b892091e44dull, 0x934aed0aab460432ull, 0xa4e4b66b68b65d60ull, 0xf81da84d5617853full,
+    0xce1de40642e3f4b9ull, 0x36251260ab9d668eull, 0x80d2ae83e9ce78f3ull, 0xc1d72b7c6b426019ull,
+    0xa1075a24e4421730ull, 0xb24cf65b8612f81full, 0xc94930ae1d529cfcull, 0xdee033f26797b627ull,
+    0xfb9b7cd9a4a7443cull, 0x169840ef017da3b1ull, 0x9d412e0806e88aa5ull, 0x8e1f289560ee864eull,
+    0xc491798a08a2ad4eull, 0xf1a6f2bab92a27e2ull, 0xf5b5d7ec8acb58a2ull, 0xae10af696774b1dbull,
+    0x9991a6f3d6bf1765ull, 0xacca6da1e0a8ef29ull, 0xbff610b0cc6edd3full, 0x17fd090a58d32af3ull,
+    0xeff394dcff8a948eull, 0xddfc4b4cef07f5b0ull, 0x95f83d0a1fb69cd9ull, 0x4abdaf101564f98eull,
+    0xbb764c4ca7a4440full, 0x9d6d1ad41abe37f1ull, 0xea53df5fd18d5513ull, 0x84c86189216dc5edull,
+    0x92746b9be2f8552cull, 0x32fd3cf5b4e49bb4ull, 0xb7118682dbb66a77ull, 0x3fbc8c33221dc2a1ull,
+    0xe4d5e82392a40515ull, 0x0fabaf3feaa5334aull, 0x8f05b1163ba6832dull, 0x29cb4d87f2a7400eull,
+    0xb2c71d5bca9023f8ull, 0x743e20e9ef511012ull, 0xdf78e4b2bd342cf6ull, 0x914da9246b255416ull,
+    0x8bab8eefb6409c1aull, 0x1ad089b6c2f7548eull, 0xae9672aba3d0c320ull, 0xa184ac2473b529b1ull,
+    0xda3c0f568cc4f3e8ull, 0xc9e5d72d90a2741eull, 0x8865899617fb1871ull, 0x7e2fa67c7a658892ull,
+    0xaa7eebfb9df9de8dull, 0xddbb901b98feeab7ull, 0xd51ea6fa85785631ull, 0x552a74227f3ea565ull,
+    0x8533285c936b35deull, 0xd53a88958f87275full, 0xa67ff273b8460356ull, 0x8a892abaf368f137ull,
+    0xd01fef10a657842cull, 0x2d2b7569b0432d85ull, 0x8213f56a67f6b29bull, 0x9c3b29620e29fc73ull,
+    0xa298f2c501f45f42ull, 0x8349f3ba91b47b8full, 0xcb3f2f7642717713ull, 0x241c70a936219a73ull,
+    0xfe0efb53d30dd4d7ull, 0xed238cd383aa0110ull, 0x9ec95d1463e8a506ull, 0xf4363804324a40aaull,
+    0xc67bb4597ce2ce48ull, 0xb143c6053edcd0d5ull, 0xf81aa16fdc1b81daull, 0xdd94b7868e94050aull,
+    0x9b10a4e5e9913128ull, 0xca7cf2b4191c8326ull, 0xc1d4ce1f63f57d72ull, 0xfd1c2f611f63a3f0ull,
+    0xf24a01a73cf2dccfull, 0xbc633b39673c8cecull, 0x976e41088617ca01ull, 0xd5be0503e085d813ull,
+    0xbd49d14aa79dbc82ull, 0x4b2d8644d8a74e18ull, 0xec9c459d51852ba2ull, 0xddf8e7d60ed1219eull,
+    0x93e1ab8252f33b45ull, 0xcabb90e5c942b503ull, 0xb8da1662e7b00a17ull, 0x3d6a751f3b936243ull,
+    0xe7109bfba19c0c9dull, 0x0cc512670a783ad4ull, 0x906a617d450187e2ull, 0x27fb2b80668b24c5ull,
+    0xb484f9dc9641e9daull, 0xb1f9f660802dedf6ull, 0xe1a63853bbd26451ull, 0x5e7873f8a0396973ull,
+    0x8d07e33455637eb2ull, 0xdb0b487b6423e1e8ull, 0xb049dc016abc5e5full, 0x91ce1a9a3d2cda62ull,
+    0xdc5c5301c56b75f7ull, 0x7641a140cc7810fbull, 0x89b9b3e11b6329baull, 0xa9e904c87fcb0a9dull,
+    0xac2820d9623bf429ull, 0x546345fa9fbdcd44ull, 0xd732290fbacaf133ull, 0xa97c177947ad4095ull,
+    0x867f59a9d4bed6c0ull, 0x49ed8eabcccc485dull, 0xa81f301449ee8c70ull, 0x5c68f256bfff5a74ull,
+    0xd226fc195c6a2f8cull, 0x73832eec6fff3111ull, 0x83585d8fd9c25db7ull, 0xc831fd53c5ff7eabull,
+    0xa42e74f3d032f525ull, 0xba3e7ca8b77f5e55ull, 0xcd3a1230c43fb26full, 0x28ce1bd2e55f35ebull,
+    0x80444b5e7aa7cf85ull, 0x7980d163cf5b81b3ull, 0xa0555e361951c366ull, 0xd7e105bcc332621full,
+    0xc86ab5c39fa63440ull, 0x8dd9472bf3fefaa7ull, 0xfa856334878fc150ull, 0xb14f98f6f0feb951ull,
+    0x9c935e00d4b9d8d2ull, 0x6ed1bf9a569f33d3ull, 0xc3b8358109e84f07ull, 0x0a862f80ec4700c8ull,
+    0xf4a642e14c6262c8ull, 0xcd27bb612758c0faull, 0x98e7e9cccfbd7dbdull, 0x8038d51cb897789cull,
+    0xbf21e44003acdd2cull, 0xe0470a63e6bd56c3ull, 0xeeea5d5004981478ull, 0x1858ccfce06cac74ull,
+    0x95527a5202df0ccbull, 0x0f37801e0c43ebc8ull, 0xbaa718e68396cffdull, 0xd30560258f54e6baull,
+    0xe950df20247c83fdull, 0x47c6b82ef32a2069ull, 0x91d28b7416cdd27eull, 0x4cdc331d57fa5441ull,
+    0xb6472e511c81471dull, 0xe0133fe4adf8e952ull, 0xe3d8f9e563a198e5ull, 0x58180fddd97723a6ull,
+    0x8e679c2f5e44ff8full, 0x570f09eaa7ea7648ull
+};
+
+static const double xjson_exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+typedef struct xjson_u128
+{
+    uint64_t low;
+    uint64_t high;
+} xjson_u128;
+
+xjson_u128 xjson_multiply_u64(uint64_t a, uint64_t b)
+{
+    xjson_u128 result;
+#if defined(__SIZEOF_INT128__)
+    __extension__ unsigned __int128 product = (unsigned __int128)a * b;
+    result.low = (uint64_t)product;
+    result.high = (uint64_t)(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    result.low = _umul128(a, b, &result.high);
+#else
+    uint64_t a_low = (uint32_t)a, a_high = a >> 32;
+    uint64_t b_low = (uint32_t)b, b_high = b >> 32;
+    uint64_t low_low = a_low * b_low;
+    uint64_t high_low = a_high * b_low;
+    uint64_t cross = (low_low >> 32) + (uint32_t)high_low + a_low * b_high;
+    result.high = (high_low >> 32) + (cross >> 32) + a_high * b_high;
+    result.low = (cross << 32) | (uint32_t)low_low;
+#endif
+    return result;
+}
+
+/* Number of leading zero bits, value must not be 0 */
+int xjson_clz64(uint64_t value)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return 63 - (int)index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if(_BitScanReverse(&index, (uint32_t)(value >> 32))) return 31 - (int)index;
+    _BitScanReverse(&index, (uint32_t)value);
+    return 63 - (int)index;
+#else
+    return __builtin_clzll(value);
+#endif
+}
+
+/* Converts w * 10^q to the closest value of the given format. w must have at most 19 digits */
+xjson_adjusted_mantissa xjson_eisel_lemire(int64_t q, uint64_t w, const xjson_float_format* format)
+{
+    xjson_adjusted_mantissa answer = { 0, 0 };
+    if(w == 0 || q < format->smallest_power_of_ten) return answer;
+    if(q > format->largest_power_of_ten)
+    {
+        answer.power2 = format->infinite_power;
+        return answer;
+    }
+
+    int lz = xjson_clz64(w);
+    w <<= lz;
+
+    // Multiply by the truncated 5^q, the lower half of it is only needed if the upper product is inconclusive
+    int index = 2 * (int)(q - XJSON_SMALLEST_POWER_OF_FIVE);
+    uint64_t precision_mask = UINT64_MAX >> (format->mantissa_bits + 3);
+    xjson_u128 product = xjson_multiply_u64(w, xjson_powers_of_five[index]);
+    if((product.high & precision_mask) == precision_mask)
+    {
+        xjson_u128 second_product = xjson_multiply_u64(w, xjson_powers_of_five[index + 1]);
+        product.low += second_product.high;
+        if(second_product.high > product.low) product.high++;
+    }
+
+    int upper_bit = (int)(product.high >> 63);
+    int shift = upper_bit + 64 - format->mantissa_bits - 3;
+    answer.mantissa = product.high >> shift;
+    // floor(log2(10^q)) + 63
+    int32_t power = (int32_t)(((152170 + 65536) * q) >> 16) + 63;
+    answer.power2 = power + upper_bit - lz - format->minimum_exponent;
+
+    if(answer.power2 <= 0)
+    {
+        // Subnormal, or zero if even the lowest bit got shifted out
+        if(-answer.power2 + 1 >= 64)
+        {
+            answer.mantissa = 0;
+            answer.power2 = 0;
+            return answer;
+        }
+
+        answer.mantissa >>= -answer.power2 + 1;
+        answer.mantissa += answer.mantissa & 1;
+        answer.mantissa >>= 1;
+        // Rounding up may have made it a normal number after all
+        answer.power2 = answer.mantissa < ((uint64_t)1 << format->mantissa_bits) ? 0 : 1;
+        return answer;
+    }
+
+    // Exactly between two floats (only zeros were shifted out), so round to even instead of up
+    if(product.low <= 1 && q >= format->min_round_to_even && q <= format->max_round_to_even && 
+        (answer.mantissa & 3) == 1 && (answer.mantissa << shift) == product.high)
+    {
+        answer.mantissa &= ~(uint64_t)1;
+    }
+
+    answer.mantissa += answer.mantissa & 1;
+    answer.mantissa >>= 1;
+    if(answer.mantissa >= ((uint64_t)2 << format->mantissa_bits))
+    {
+        answer.mantissa = (uint64_t)1 << format->mantissa_bits;
+        answer.power2++;
+    }
+
+    // Remove the implicit bit
+    answer.mantissa &= ~((uint64_t)1 << format->mantissa_bits);
+    if(answer.power2 >= format->infinite_power)
+    {
+        answer.mantissa = 0;
+        answer.power2 = format->infinite_power;
+    }
+    return answer;
+}
+
+#define XJSON_DECIMAL_DIGITS 768
+#define XJSON_DECIMAL_POINT_RANGE 2047
+
+/* Arbitrary precision decimal used by the exact fallback, value is 0.digits * 10^decimal_point */
+typedef struct xjson_decimal
+{
+    uint32_t num_digits;
+    int32_t decimal_point;
+    // Set if there were more than XJSON_DECIMAL_DIGITS digits and some of the dropped ones weren't 0
+    bool truncated;
+    uint8_t digits[XJSON_DECIMAL_DIGITS];
+} xjson_decimal;
+
+void xjson_decimal_parse(xjson_decimal* decimal, const uint8_t* ptr, const uint8_t* end)
+{
+    decimal->num_digits = 0;
+    decimal->decimal_point = 0;
+    decimal->truncated = false;
+
+    if(*ptr == '-') ptr++;
+    while(ptr < end && *ptr == '0') ptr++;
+    for(; ptr < end && (uint8_t)(*ptr - '0') <= 9; ptr++)
+    {
+        if(decimal->num_digits < XJSON_DECIMAL_DIGITS) decimal->digits[decimal->num_digits] = *ptr - '0';
+        decimal->num_digits++;
+    }
+
+    if(ptr < end && *ptr == '.')
+    {
+        ptr++;
+        const uint8_t* first_after_period = ptr;
+        if(decimal->num_digits == 0)
+        {
+            while(ptr < end && *ptr == '0') ptr++;
+        }
+        for(; ptr < end && (uint8_t)(*ptr - '0') <= 9; ptr++)
+        {
+            if(decimal->num_digits < XJSON_DECIMAL_DIGITS) decimal->digits[decimal->num_digits] = *ptr - '0';
+            decimal->num_digits++;
+        }
+        decimal->decimal_point = (int32_t)(first_after_period - ptr);
+    }
+
+    if(decimal->num_digits > 0)
+    {
+        // Trailing zeros don't count as digits
+        const uint8_t* reverse = ptr - 1;
+        uint32_t trailing_zeros = 0;
+        while(*reverse == '0' || *reverse == '.')
+        {
+            if(*reverse == '0') trailing_zeros++;
+            reverse--;
+        }
+        decimal->decimal_point += (int32_t)decimal->num_digits;
+        decimal->num_digits -= trailing_zeros;
+    }
+    if(decimal->num_digits > XJSON_DECIMAL_DIGITS)
+    {
+        decimal->truncated = true;
+        decimal->num_digits = XJSON_DECIMAL_DIGITS;
+    }
+
+    if(ptr < end && (*ptr == 'e' || *ptr == 'E'))
+    {
+        ptr++;
+        bool negative = ptr < end && *ptr == '-';
+        if(ptr < end && (*ptr == '-' || *ptr == '+')) ptr++;
+
+        int32_t exponent = 0;
+        for(; ptr < end && (uint8_t)(*ptr - '0') <= 9; ptr++)
+        {
+            if(exponent < 0x10000) exponent = exponent * 10 + (*ptr - '0');
+        }
+        decimal->decimal_point += negative ? -exponent : exponent;
+    }
+}
+
+void xjson_decimal_trim(xjson_decimal* decimal)
+{
+    while(decimal->num_digits > 0 && decimal->digits[decimal->num_digits - 1] == 0)
+    {
+        decimal->num_digits--;
+    }
+}
+
+/* Multiplies the decimal by 2^shift, shift is at most 60 */
+void xjson_decimal_left_shift(xjson_decimal* decimal, uint32_t shift)
+{
+    if(decimal->num_digits == 0) return;
+
+    // Work from the least significant digit, writing the result back to front
+    uint8_t buffer[XJSON_DECIMAL_DIGITS + 20];
+    uint32_t write_index = sizeof(buffer);
+    uint64_t n = 0;
+    for(int32_t read_index = (int32_t)decimal->num_digits - 1; read_index >= 0; read_index--)
+    {
+        n += (uint64_t)decimal->digits[read_index] << shift;
+        buffer[--write_index] = (uint8_t)(n % 10);
+        n /= 10;
+    }
+    while(n > 0)
+    {
+        buffer[--write_index] = (uint8_t)(n % 10);
+        n /= 10;
+    }
+
+    uint32_t count = sizeof(buffer) - write_index;
+    decimal->decimal_point += (int32_t)(count - decimal->num_digits);
+    if(count > XJSON_DECIMAL_DIGITS)
+    {
+        for(uint32_t i = write_index + XJSON_DECIMAL_DIGITS; i < sizeof(buffer); i++)
+        {
+            if(buffer[i] != 0) decimal->truncated = true;
+        }
+        count = XJSON_DECIMAL_DIGITS;
+    }
+
+    memcpy(decimal->digits, buffer + write_index, count);
+    decimal->num_digits = count;
+    xjson_decimal_trim(decimal);
+}
+
+/* Divides the decimal by 2^shift, shift is at most 60 */
+void xjson_decimal_right_shift(xjson_decimal* decimal, uint32_t shift)
+{
+    uint32_t read_index = 0;
+    uint32_t write_index = 0;
+    uint64_t n = 0;
+
+    // Read digits until there's something to shift out
+    while((n >> shift) == 0)
+    {
+        if(read_index < decimal->num_digits)
+        {
+            n = 10 * n + decimal->digits[read_index++];
+        }
+        else if(n == 0)
+        {
+            return;
+        }
+        else
+        {
+            while((n >> shift) == 0)
+            {
+                n = 10 * n;
+                read_index++;
+            }
+            break;
+        }
+    }
+
+    decimal->decimal_point -= (int32_t)(read_index - 1);
+    if(decimal->decimal_point < -XJSON_DECIMAL_POINT_RANGE)
+    {
+        decimal->num_digits = 0;
+        decimal->decimal_point = 0;
+        decimal->truncated = false;
+        return;
+    }
+
+    uint64_t mask = ((uint64_t)1 << shift) - 1;
+    while(read_index < decimal->num_digits)
+    {
+        uint8_t new_digit = (uint8_t)(n >> shift);
+        n = 10 * (n & mask) + decimal->digits[read_index++];
+        decimal->digits[write_index++] = new_digit;
+    }
+    while(n > 0)
+    {
+        uint8_t new_digit = (uint8_t)(n >> shift);
+        n = 10 * (n & mask);
+        if(write_index < XJSON_DECIMAL_DIGITS)
+        {
+            decimal->digits[write_index++] = new_digit;
+        }
+        else if(new_digit > 0)
+        {
+            decimal->truncated = true;
+        }
+    }
+
+    decimal->num_digits = write_index;
+    xjson_decimal_trim(decimal);
+}
+
+/* Integer part of the decimal, rounded half to even */
+uint64_t xjson_decimal_round(xjson_decimal* decimal)
+{
+    if(decimal->num_digits == 0 || decimal->decimal_point < 0) return 0;
+    if(decimal->decimal_point > 18) return UINT64_MAX;
+
+    uint32_t point = (uint32_t)decimal->decimal_point;
+    uint64_t n = 0;
+    for(uint32_t i = 0; i < point; i++)
+    {
+        n = 10 * n + (i < decimal->num_digits ? decimal->digits[i] : 0);
+    }
+
+    bool round_up = false;
+    if(point < decimal->num_digits)
+    {
+        round_up = decimal->digits[point] >= 5;
+        if(decimal->digits[point] == 5 && point + 1 == decimal->num_digits)
+        {
+            round_up = decimal->truncated || (point > 0 && (decimal->digits[point - 1] & 1));
+        }
+    }
+    return round_up ? n + 1 : n;
+}
+
+/* Exact conversion of a decimal number, by shifting it into the range [1, 2) */
+xjson_adjusted_mantissa xjson_decimal_to_float(const uint8_t* start, const uint8_t* end, const xjson_float_format* format)
+{
+    // Maximum shift so that each step fits in 64 bits, and the shift needed to cover 10^n for n < 19
+    static const uint32_t max_shift = 60;
+    static const uint8_t shifts[19] = { 0, 3, 6, 9, 13, 16, 19, 23, 26, 29, 33, 36, 39, 43, 46, 49, 53, 56, 59 };
+
+    xjson_adjusted_mantissa zero = { 0, 0 };
+    xjson_adjusted_mantissa infinity = { 0, format->infinite_power };
+    xjson_decimal decimal;
+    xjson_decimal_parse(&decimal, start, end);
+
+    if(decimal.num_digits == 0 || decimal.decimal_point < -324) return zero;
+    if(decimal.decimal_point >= 310) return infinity;
+
+    int32_t exp2 = 0;
+    while(decimal.decimal_point > 0)
+    {
+        uint32_t n = (uint32_t)decimal.decimal_point;
+        uint32_t shift = n < 19 ? shifts[n] : max_shift;
+        xjson_decimal_right_shift(&decimal, shift);
+        if(decimal.decimal_point < -XJSON_DECIMAL_POINT_RANGE) return zero;
+        exp2 += (int32_t)shift;
+    }
+
+    // Shift left toward [1/2, 1]
+    while(decimal.decimal_point <= 0)
+    {
+        uint32_t shift;
+        if(decimal.decimal_point == 0)
+        {
+            if(decimal.digits[0] >= 5) break;
+            shift = decimal.digits[0] < 2 ? 2 : 1;
+        }
+        else
+        {
+            uint32_t n = (uint32_t)-decimal.decimal_point;
+            shift = n < 19 ? shifts[n] : max_shift;
+        }
+
+        xjson_decimal_left_shift(&decimal, shift);
+        if(decimal.decimal_point > XJSON_DECIMAL_POINT_RANGE) return infinity;
+        exp2 -= (int32_t)shift;
+    }
+
+    // Now in [1/2, 1], but the binary format uses [1, 2)
+    exp2--;
+    while(format->minimum_exponent + 1 > exp2)
+    {
+        uint32_t n = (uint32_t)(format->minimum_exponent + 1 - exp2);
+        if(n > max_shift) n = max_shift;
+        xjson_decimal_right_shift(&decimal, n);
+        exp2 += (int32_t)n;
+    }
+    if(exp2 - format->minimum_exponent >= format->infinite_power) return infinity;
+
+    int mantissa_size = format->mantissa_bits + 1;
+    xjson_decimal_left_shift(&decimal, mantissa_size);
+    uint64_t mantissa = xjson_decimal_round(&decimal);
+
+    // Rounding may have overflown into another bit
+    if(mantissa >= ((uint64_t)1 << mantissa_size))
+    {
+        xjson_decimal_right_shift(&decimal, 1);
+        exp2 += 1;
+        mantissa = xjson_decimal_round(&decimal);
+        if(exp2 - format->minimum_exponent >= format->infinite_power) return infinity;
+    }
+
+    xjson_adjusted_mantissa answer;
+    answer.power2 = exp2 - format->minimum_exponent;
+    if(mantissa < ((uint64_t)1 << format->mantissa_bits)) answer.power2--;
+    answer.mantissa = mantissa & (((uint64_t)1 << format->mantissa_bits) - 1);
+    return answer;
+}
+
+/* Scans a json number at current into significand and exponent, and moves past it */
+void xjson_expect_number(xjson* json, xjson_number* number)
+{
+    if(json->error) return;
+
+    uint8_t* ptr = json->current;
+    number->start = ptr;
+    number->significand = 0;
+    number->exponent = 0;
+    number->truncated = false;
+    number->negative = ptr < json->end && *ptr == '-';
+    if(number->negative) ptr++;
+
+    // Leading zeros are skipped, after 19 significant digits only the exponent is adjusted
+    int significant_digits = 0;
+    bool has_digits = false;
+    for(; ptr < json->end && (uint8_t)(*ptr - '0') <= 9; ptr++)
+    {
+        uint8_t digit = *ptr - '0';
+        has_digits = true;
+        if(significant_digits < 19)
+        {
+            number->significand = number->significand * 10 + digit;
+            if(number->significand != 0) significant_digits++;
+        }
+        else
+        {
+            number->exponent++;
+            if(digit != 0) number->truncated = true;
+        }
+    }
+
+    if(ptr < json->end && *ptr == '.')
+    {
+        for(ptr++; ptr < json->end && (uint8_t)(*ptr - '0') <= 9; ptr++)
+        {
+            uint8_t digit = *ptr - '0';
+            has_digits = true;
+            if(significant_digits < 19)
+            {
+                number->significand = number->significand * 10 + digit;
+                number->exponent--;
+                if(number->significand != 0) significant_digits++;
+            }
+            else if(digit != 0)
+            {
+                number->truncated = true;
+            }
+        }
+    }
+
+    if(!has_digits)
+    {
+        xjson_error(json, "Invalid number found. Couldn't parse value.");
+        return;
+    }
+
+    if(ptr < json->end && (*ptr == 'e' || *ptr == 'E'))
+    {
+        ptr++;
+        bool negative = ptr < json->end && *ptr == '-';
+        if(ptr < json->end && (*ptr == '-' || *ptr == '+')) ptr++;
+
+        if(ptr >= json->end || (uint8_t)(*ptr - '0') > 9)
+        {
+            json->current = ptr;
+            xjson_error(json, "Invalid number found. Exponent is missing.");
+            return;
+        }
+
+        // Anything beyond this is zero or infinity anyway
+        int64_t exponent = 0;
+        for(; ptr < json->end && (uint8_t)(*ptr - '0') <= 9; ptr++)
+        {
+            if(exponent < 0x10000000) exponent = exponent * 10 + (*ptr - '0');
+        }
+        number->exponent += negative ? -exponent : exponent;
+    }
+
+    number->end = ptr;
+
+    // Move pointer to end of number value
+    json->current = ptr;
+    if(xjson_is_white_space(xjson_peek(json))){
+        xjson_consume(json);
+    }
+}
+
+/* Converts a scanned number to the bits of the given format, without the sign */
+uint64_t xjson_number_to_bits(const xjson_number* number, const xjson_float_format* format)
+{
+    xjson_adjusted_mantissa answer = xjson_eisel_lemire(number->exponent, number->significand, format);
+    if(number->truncated)
+    {
+        // The dropped digits only matter if rounding the next larger significand gives a different result
+        xjson_adjusted_mantissa answer_up = xjson_eisel_lemire(number->exponent, number->significand + 1, format);
+        if(answer.mantissa != answer_up.mantissa || answer.power2 != answer_up.power2)
+        {
+            answer = xjson_decimal_to_float(number->start, number->end, format);
+        }
+    }
+
+    return answer.mantissa | ((uint64_t)answer.power2 << format->mantissa_bits);
+}
+
+void xjson_expect_and_parse_double(xjson* json, double* out_value)
+{
+    xjson_number number;
+    xjson_expect_number(json, &number);
+    if(json->error) return;
+
+    double value;
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    // Both the significand and the power of ten are exact doubles, so a single operation rounds correctly
+    if(!number.truncated && number.exponent >= -22 && number.exponent <= 22 && number.significand <= ((uint64_t)1 << 53))
+    {
+        value = (double)number.significand;
+        if(number.exponent < 0)
+            value /= xjson_exact_powers_of_ten[-number.exponent];
+        else
+            value *= xjson_exact_powers_of_ten[number.exponent];
+
+        *out_value = number.negative ? -value : value;
+        return;
+    }
+#endif
+
+    uint64_t bits = xjson_number_to_bits(&number, &xjson_double_format);
+    memcpy(&value, &bits, sizeof(value));
+    *out_value = number.negative ? -value : value;
+}
+
+void xjson_expect_and_parse_float(xjson* json, float* out_value)
+{
+    xjson_number number;
+    xjson_expect_number(json, &number);
+    if(json->error) return;
+
+    float value;
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    if(!number.truncated && number.exponent >= -10 && number.exponent <= 10 && number.significand <= ((uint64_t)1 << 24))
+    {
+        value = (float)number.significand;
+        if(number.exponent < 0)
+            value /= (float)xjson_exact_powers_of_ten[-number.exponent];
+        else
+            value *= (float)xjson_exact_powers_of_ten[number.exponent];
+
+        *out_value = number.negative ? -value : value;
+        return;
+    }
+#endif
+
+    uint32_t bits = (uint32_t)xjson_number_to_bits(&number, &xjson_single_format);
+    memcpy(&value, &bits, sizeof(value));
+    *out_value = number.negative ? -value : value;
+}
+
+/* Parses the string at the current location, str_start points to its first character. Returns true if it contains escapes */
+bool xjson_expect_string(xjson* json, const uint8_t** str_start, size_t* str_len)
+{
+    *str_len = 0;
+    if(json->error) return false;
+    if(xjson_peek(json) != '\"')
+    {
+        xjson_error(json, "Unexpected token found.");
+        return false;
+    }
+
+    // Leading white space belongs to the string, so don't consume past the quote
+    uint8_t* start = json->current + 1;
+    uint8_t* ptr = xjson_scan_string(start, json->end);
+    bool has_escapes = ptr < json->end && *ptr == '\\';
+    if(has_escapes) ptr = xjson_find_string_end(json, ptr);
+    if(ptr >= json->end)
+    {
+        json->current = json->end;
+        xjson_error(json, "Unexpected end of json found.");
+        return false;
+    }
+
+    *str_start = start;
+    *str_len = ptr - start;
+    json->current = ptr;
+    xjson_expect(json, '\"');
+    return has_escapes;
+}
+
+/* Decodes the escape sequences of the string in place and zero-terminates it. Returns the decoded length, 
+   or -1 if there is an invalid escape. Decoding never makes a string longer, so it can't overrun. */
+int64_t xjson_unescape_string(char* str, size_t len)
+{
+    uint8_t* read = (uint8_t*)str;
+    uint8_t* write = (uint8_t*)str;
+    uint8_t* end = (uint8_t*)str + len;
+    for(;;)
+    {
+        // Copy everything up to the next escape in bulk. There are no unescaped quotes left in a parsed string.
+        uint8_t* escape = xjson_scan_string(read, end);
+        if(write != read) memmove(write, read, escape - read);
+        write += escape - read;
+        read = escape;
+        if(read >= end) break;
+
+        size_t decoded_len;
+        read = (uint8_t*)xjson_decode_escape(read, end, write, &decoded_len);
+        if(read == NULL) return -1;
+        write += decoded_len;
+    }
+
+    *write = '\0';
+    return write - (uint8_t*)str;
+}
+
+/* Copies the string with the string allocator, decoding any escape sequences */
+char* xjson_allocate_string(xjson* json, const uint8_t* str_start, size_t str_len, bool has_escapes, size_t* decoded_len)
+{
+    char* str = json->string_allocator((const char*)str_start, str_len, json->mem_ctx);
+    if(str == NULL)
+    {
+        xjson_error(json, "Failed to allocate string.");
+        return NULL;
+    }
+    XJSON_STATS_ADD(json, string_allocations, 1);
+    XJSON_STATS_ADD(json, string_bytes, str_len);
+
+    *decoded_len = str_len;
+    if(has_escapes)
+    {
+        int64_t len = xjson_unescape_string(str, str_len);
+        if(len < 0)
+        {
+            xjson_error(json, "Invalid escape sequence in string.");
+            return str;
+        }
+        *decoded_len = (size_t)len;
+    }
+    return str;
+}
+
+void xjson_expect_and_parse_string(xjson* json, const char** str)
+{
+    const uint8_t* str_start;
+    size_t str_len;
+    bool has_escapes = xjson_expect_string(json, &str_start, &str_len);
+    if(json->error) return;
+
+    size_t decoded_len;
+    *str = xjson_allocate_string(json, str_start, str_len, has_escapes, &decoded_len);
+}
+
+void xjson_expect_and_parse_string_view(xjson* json, const char** str, size_t* len)
+{
+    const uint8_t* str_start;
+    size_t str_len;
+    bool has_escapes = xjson_expect_string(json, &str_start, &str_len);
+    if(json->error) return;
+
+    if(has_escapes)
+    {
+        *str = xjson_allocate_string(json, str_start, str_len, true, len);
+    }
+    else
+    {
+        *str = (const char*)str_start;
+        *len = str_len;
+    }
+}
+
+void xjson_expect_and_parse_bool(xjson* json, bool* val)
+{
+    if(json->error) return;
+
+    if(xjson_peek(json) == 't')
+    {
+        xjson_expect_token(json, "true", 4);
+        if(!json->error)
+            *val = true;
+    }
+    else if(xjson_peek(json) == 'f')
+    {
+        xjson_expect_token(json, "false", 5);
+        if(!json->error)
+            *val = false;
+    }
+    else 
+    {
+        xjson_error(json, "Unexpected token whilst parsing bool.");
+    }
+}
+
+/* Appends len bytes of output to a cache entry being recorded */
+void xjson_cache_append(xjson_cache_entry* entry, const uint8_t* data, size_t len)
+{
+    if(entry->failed || len == 0) return;
+
+    if(entry->len + len > entry->capacity)
+    {
+        size_t capacity = entry->capacity * 2 > entry->len + len ? entry->capacity * 2 : entry->len + len;
+        uint8_t* data_new = (uint8_t*)XJSON_MALLOC(capacity);
+        if(data_new == NULL)
+        {
+            // Not worth failing the whole output for, the object just isn't cached
+            entry->failed = true;
+            return;
+        }
+        if(entry->len > 0) memcpy(data_new, entry->data, entry->len);
+        XJSON_FREE(entry->data);
+        entry->data = data_new;
+        entry->capacity = capacity;
+    }
+    memcpy(entry->data + entry->len, data, len);
+    entry->len += len;
+}
+
+/* Copies the output that is still in the buffer to all objects being recorded, before the buffer is reused */
+void xjson_cache_capture(xjson* json)
+{
+    for(xjson_cache_entry* entry = json->cache_recording; entry != NULL; entry = entry->outer)
+    {
+        xjson_cache_append(entry, entry->record_from, json->current - entry->record_from);
+        entry->record_from = json->start;
+    }
+}
+
+/* Copies output that goes to the sink without passing through the buffer to all objects being recorded */
+void xjson_cache_capture_direct(xjson* json, const uint8_t* data, size_t len)
+{
+    for(xjson_cache_entry* entry = json->cache_recording; entry != NULL; entry = entry->outer)
+    {
+        xjson_cache_append(entry, data, len);
+    }
+}
+
+/* Called when an object/array was closed in write-mode, completes the recording of a cached object */
+void xjson_cache_scope_end(xjson* json)
+{
+    xjson_cache_entry* entry = json->cache_recording;
+    if(entry == NULL || entry->depth != json->intendation) return;
+
+    xjson_cache_append(entry, entry->record_from, json->current - entry->record_from);
+    entry->valid = !entry->failed && !json->error;
+    entry->recording = false;
+    json->cache_recording = entry->outer;
+}
+
+/* Stops all recordings, e.g. when the output was abandoned because of an error */
+void xjson_cache_abort(xjson* json)
+{
+    for(xjson_cache_entry* entry = json->cache_recording; entry != NULL; entry = entry->outer)
+    {
+        entry->recording = false;
+    }
+    json->cache_recording = NULL;
+}
+
+/* Hands everything written so far to the sink and starts over at the beginning of the chunk */
+void xjson_flush(xjson* json)
+{
+    if(json->error || json->flush == NULL) return;
+
+    if(json->current > json->start && !json->flush((const char*)json->start, json->current - json->start, json->flush_user))
+    {
+        xjson_error(json, "Failed to flush the output.");
+        return;
+    }
+    XJSON_STATS_BYTES(json);
+    xjson_cache_capture(json);
+    json->current = json->start;
+    XJSON_STATS_MARK(json);
+}
+
+/* Returns true if len bytes can be written at current. In sink mode the chunk is flushed to make room. */
+bool xjson_has_room(xjson* json, size_t len)
+{
+    // Nothing is written in measure-mode, callers fall back to xjson_print_token which counts
+    if(json->mode == XJSON_STATE_MEASURE) return false;
+    if((size_t)(json->end - json->current) >= len) return true;
+    if(json->flush == NULL) return false;
+
+    xjson_flush(json);
+    return !json->error && (size_t)(json->end - json->current) >= len;
+}
+
+void xjson_print_token(xjson* json, const char* token, size_t len)
+{
+    if(json->error) return;
+
+    if(json->mode == XJSON_STATE_MEASURE)
+    {
+        json->measure_size += len;
+        return;
+    }
+
+    if(!xjson_has_room(json, len))
+    {
+        if(json->flush != NULL && !json->error)
+        {
+            // Larger than a whole chunk, pass it on as is
+            if(!json->flush(token, len, json->flush_user))
+                xjson_error(json, "Failed to flush the output.");
+            XJSON_STATS_ADD(json, bytes_written, len);
+            xjson_cache_capture_direct(json, (const uint8_t*)token, len);
+            return;
+        }
+
+        xjson_error(json, "Write buffer is too small to write to. Abort.");
+        return;
+    }
+
+    memcpy(json->current, token, len);
+    json->current += len;
+}
+
+/* Writes the escape sequence of c (a quote, backslash or control character) to buffer and returns its length */
+size_t xjson_escape_char(uint8_t c, char buffer[6])
+{
+    buffer[0] = '\\';
+    switch(c)
+    {
+    case '\"': buffer[1] = '\"'; return 2;
+    case '\\': buffer[1] = '\\'; return 2;
+    case '\b': buffer[1] = 'b'; return 2;
+    case '\f': buffer[1] = 'f'; return 2;
+    case '\n': buffer[1] = 'n'; return 2;
+    case '\r': buffer[1] = 'r'; return 2;
+    case '\t': buffer[1] = 't'; return 2;
+    default:
+    {
+        static const char hex[] = "0123456789abcdef";
+        memcpy(buffer + 1, "u00", 3);
+        buffer[4] = hex[c >> 4];
+        buffer[5] = hex[c & 0xF];
+        return 6;
+    }
+    }
+}
+
+void xjson_print_string(xjson* json, const char* str, size_t len)
+{
+    if(json->error) return;
+    xjson_print_token(json, "\"", 1);
+
+    const uint8_t* ptr = (const uint8_t*)str;
+    const uint8_t* end = ptr + len;
+    for(;;)
+    {
+        // Everything up to the next character that needs escaping is written as is
+        const uint8_t* escape = xjson_scan_escape(ptr, end);
+        if(escape != ptr) xjson_print_token(json, (const char*)ptr, escape - ptr);
+        if(escape >= end) break;
+
+        char buffer[6];
+        xjson_print_token(json, buffer, xjson_escape_char(*escape, buffer));
+        ptr = escape + 1;
+    }
+
+    xjson_print_token(json, "\"", 1);
+}
+
+void xjson_print_key(xjson* json, const char* key, size_t key_len)
+{
+    if(json->error) return;
+    xjson_print_string(json, key, key_len);
+    xjson_print_token(json, ":", 1);
+    XJSON_STATS_KEY(json);
+}
+
+void xjson_print_new_line(xjson* json)
+{
+    if(json->error) return;
+    if(json->mode == XJSON_STATE_MEASURE)
+    {
+        json->measure_size += 1 + json->intendation;
+        return;
+    }
+    xjson_print_token(json, "\n", 1);
+    for(int i=0; i<json->intendation; i++)
+    {
+        xjson_print_token(json, "\t", 1);
+    }
+}
+
+/* Writes everything that goes in front of a value: the separating ',', a new line when pretty printing and the key */
+void xjson_print_value_prefix_len(xjson* json, const char* key, size_t key_len)
+{
+    if(json->error) return;
+
+    // The key was already written by xjson_key
+    if(json->after_key)
+    {
+        json->after_key = false;
+        return;
+    }
+
+    if(json->needs_comma) xjson_print_token(json, ",", 1);
+    if(json->pretty_print && json->intendation != 0) xjson_print_new_line(json);
+    if(key != NULL) xjson_print_key(json, key, key_len);
+}
+
+void xjson_print_value_prefix(xjson* json, const char* key)
+{
+    xjson_print_value_prefix_len(json, key, key != NULL ? strlen(key) : 0);
+}
+
+/* The root object/array is complete. The sink receives the rest of the output, or the json output buffer is zero-terminated */
+void xjson_print_document_end(xjson* json)
+{
+    if(json->flush != NULL)
+    {
+        xjson_flush(json);
+    }
+    else if(!json->error && json->mode == XJSON_STATE_WRITE && json->format == XJSON_FORMAT_JSON)
+    {
+        if(json->current >= json->end)
+        {
+            xjson_error(json, "Write buffer is too small to write to. Abort.");
+            return;
+        }
+        *json->current = '\0';
+    }
+}
+
+/* Closes an object/array in write mode */
+void xjson_print_scope_end(xjson* json, const char* token)
+{
+    if(json->pretty_print) xjson_print_new_line(json);
+    xjson_print_token(json, token, 1);
+    json->needs_comma = true;
+
+    xjson_cache_scope_end(json);
+    if(json->intendation == 0) xjson_print_document_end(json);
+}
+
+//----------------------------------------------------------------------------------
+// Integer formatting
+//----------------------------------------------------------------------------------
+
+/* Longest decimal representation of each xjson_int_type, including the sign */
+static const uint8_t xjson_int_max_length[] = { 3, 5, 10, 20, 4, 6, 11, 20 };
+
+static const char xjson_digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+int xjson_count_digits(uint64_t value)
+{
+    int digits = 1;
+    for(;;)
+    {
+        if(value < 10) return digits;
+        if(value < 100) return digits + 1;
+        if(value < 1000) return digits + 2;
+        if(value < 10000) return digits + 3;
+        value /= 10000;
+        digits += 4;
+    }
+}
+
+/* Writes value in decimal, two digits at a time from the back. Returns the length, buffer needs 20 bytes */
+int xjson_format_u64(char* buffer, uint64_t value)
+{
+    int len = xjson_count_digits(value);
+    char* ptr = buffer + len;
+
+    // 64 bit divisions only as long as needed
+    while(value > UINT32_MAX)
+    {
+        uint64_t quotient = value / 100;
+        uint32_t pair = (uint32_t)(value - quotient * 100);
+        ptr -= 2;
+        memcpy(ptr, &xjson_digit_pairs[pair * 2], 2);
+        value = quotient;
+    }
+
+    uint32_t small = (uint32_t)value;
+    while(small >= 100)
+    {
+        uint32_t quotient = small / 100;
+        uint32_t pair = small - quotient * 100;
+        ptr -= 2;
+        memcpy(ptr, &xjson_digit_pairs[pair * 2], 2);
+        small = quotient;
+    }
+
+    if(small >= 10)
+    {
+        ptr -= 2;
+        memcpy(ptr, &xjson_digit_pairs[small * 2], 2);
+    }
+    else
+    {
+        *--ptr = (char)('0' + small);
+    }
+    return len;
+}
+
+/* Prints an integer given as magnitude and sign. Formats straight into the output if there's room for max_length characters */
+void xjson_print_integer(xjson* json, uint64_t magnitude, bool negative, int max_length)
+{
+    if(json->error) return;
+
+    if(json->mode == XJSON_STATE_MEASURE)
+    {
+        json->measure_size += (negative ? 1 : 0) + xjson_count_digits(magnitude);
+    }
+    else if(xjson_has_room(json, max_length))
+    {
+        if(negative) *json->current++ = '-';
+        json->current += xjson_format_u64((char*)json->current, magnitude);
+    }
+    else
+    {
+        char buffer[24];
+        int len = 0;
+        if(negative) buffer[len++] = '-';
+        len += xjson_format_u64(buffer + len, magnitude);
+        xjson_print_token(json, buffer, len);
+    }
+}
+
+/* Range checks a parsed integer and stores it into val of the given type */
+void xjson_store_integer(xjson* json, void* val, xjson_int_type type, uint64_t magnitude, bool negative)
+{
+    // Largest positive value of each type, indexed by xjson_int_type. Negative values of signed types may be one larger.
+    static const uint64_t limits[] = { 
+        UINT8_MAX, UINT16_MAX, UINT32_MAX, UINT64_MAX, 
+        INT8_MAX, INT16_MAX, INT32_MAX, INT64_MAX 
+    };
+    bool is_signed = type >= XJSON_INT_TYPE_I8;
+    if(negative ? (is_signed ? magnitude > limits[type] + 1 : magnitude != 0) : magnitude > limits[type])
+    {
+        xjson_error(json, "Integer value out of range.");
+        return;
+    }
+
+    // Two's complement of the magnitude for negative values, the casts below truncate to the right width
+    uint64_t number = negative ? 0 - magnitude : magnitude;
+    switch (type)
+    {
+    case XJSON_INT_TYPE_U8:
+        *(uint8_t*)val = (uint8_t)number;
+        break;
+    case XJSON_INT_TYPE_U16:
+        *(uint16_t*)val = (uint16_t)number;
+        break;
+    case XJSON_INT_TYPE_U32:
+        *(uint32_t*)val = (uint32_t)number;
+        break;
+    case XJSON_INT_TYPE_U64:
+        *(uint64_t*)val = (uint64_t)number;
+        break;
+    case XJSON_INT_TYPE_I8:
+        *(int8_t*)val = (int8_t)number;
+        break;
+    case XJSON_INT_TYPE_I16:
+        *(int16_t*)val = (int16_t)number;
+        break;
+    case XJSON_INT_TYPE_I32:
+        *(int32_t*)val = (int32_t)number;
+        break;
+    case XJSON_INT_TYPE_I64:
+        *(int64_t*)val = (int64_t)number;
+        break;
+    default:
+        xjson_error(json, "Unknown integer type.");
+        break;
+    }
+}
+
+/* Splits the integer in val into magnitude and sign, negating in uint64 so the minimum values don't overflow */
+uint64_t xjson_load_integer(const void* val, xjson_int_type type, bool* negative)
+{
+    int64_t number = 0;
+    switch (type)
+    {
+    case XJSON_INT_TYPE_U8:
+        *negative = false;
+        return *(const uint8_t*)val;
+    case XJSON_INT_TYPE_U16:
+        *negative = false;
+        return *(const uint16_t*)val;
+    case XJSON_INT_TYPE_U32:
+        *negative = false;
+        return *(const uint32_t*)val;
+    case XJSON_INT_TYPE_U64:
+        *negative = false;
+        return *(const uint64_t*)val;
+    case XJSON_INT_TYPE_I8:
+        number = *(const int8_t*)val;
+        break;
+    case XJSON_INT_TYPE_I16:
+        number = *(const int16_t*)val;
+        break;
+    case XJSON_INT_TYPE_I32:
+        number = *(const int32_t*)val;
+        break;
+    case XJSON_INT_TYPE_I64:
+        number = *(const int64_t*)val;
+        break;
+    }
+
+    *negative = number < 0;
+    return *negative ? 0 - (uint64_t)number : (uint64_t)number;
+}
+
+// Element types of xjson_number_array, the integer types are the same as xjson_int_type
+#define XJSON_NUMBER_TYPE_FLOAT (XJSON_INT_TYPE_I64 + 1)
+#define XJSON_NUMBER_TYPE_DOUBLE (XJSON_INT_TYPE_I64 + 2)
+
+/* Size in bytes of each number type */
+static const size_t xjson_number_size[] = { 1, 2, 4, 8, 1, 2, 4, 8, 4, 8 };
+
+//----------------------------------------------------------------------------------
+// Floating-point formatting
+//
+// Values are written with Grisu2 (see Loitsch, "Printing Floating-Point Numbers Quickly and 
+// Accurately with Integers"), in the variant used by RapidJSON. It produces the shortest digits 
+// that read back to the same float/double in nearly all cases, and digits that still round-trip 
+// otherwise. Floats use their own (wider) rounding boundaries, so they get fewer digits than the 
+// same value as a double would.
+//----------------------------------------------------------------------------------
+
+#define XJSON_FLOAT_MAX_LENGTH 32
+
+/* A value as f * 2^e with a 64 bit significand */
+typedef struct xjson_diy_fp
+{
+    uint64_t f;
+    int e;
+} xjson_diy_fp;
+
+/* Normalized 10^-348, 10^-340, ..., 10^340 as significands and binary exponents */
+static const uint64_t xjson_cached_powers_f[] = {
+    0xfa8fd5a0081c0288ull, 0xbaaee17fa23ebf76ull, 0x8b16fb203055ac76ull, 0xcf42894a5dce35eaull,
+    0x9a6bb0aa55653b2dull, 0xe61acf033d1a45dfull, 0xab70fe17c79ac6caull, 0xff77b1fcbebcdc4full,
+    0xbe5691ef416bd60cull, 0x8dd01fad907ffc3cull, 0xd3515c2831559a83ull, 0x9d71ac8fada6c9b5ull,
+    0xea9c227723ee8bcbull, 0xaecc49914078536dull, 0x823c12795db6ce57ull, 0xc21094364dfb5637ull,
+    0x9096ea6f3848984full, 0xd77485cb25823ac7ull, 0xa086cfcd97bf97f4ull, 0xef340a98172aace5ull,
+    0xb23867fb2a35b28eull, 0x84c8d4dfd2c63f3bull, 0xc5dd44271ad3cdbaull, 0x936b9fcebb25c996ull,
+    0xdbac6c247d62a584ull, 0xa3ab66580d5fdaf6ull, 0xf3e2f893dec3f126ull, 0xb5b5ada8aaff80b8ull,
+    0x87625f056c7c4a8bull, 0xc9bcff6034c13053ull, 0x964e858c91ba2655ull, 0xdff9772470297ebdull,
+    0xa6dfbd9fb8e5b88full, 0xf8a95fcf88747d94ull, 0xb94470938fa89bcfull, 0x8a08f0f8bf0f156bull,
+    0xcdb02555653131b6ull, 0x993fe2c6d07b7facull, 0xe45c10c42a2b3b06ull, 0xaa242499697392d3ull,
+    0xfd87b5f28300ca0eull, 0xbce5086492111aebull, 0x8cbccc096f5088ccull, 0xd1b71758e219652cull,
+    0x9c40000000000000ull, 0xe8d4a51000000000ull, 0xad78ebc5ac620000ull, 0x813f3978f8940984ull,
+    0xc097ce7bc90715b3ull, 0x8f7e32ce7bea5c70ull, 0xd5d238a4abe98068ull, 0x9f4f2726179a2245ull,
+    0xed63a231d4c4fb27ull, 0xb0de65388cc8ada8ull, 0x83c7088e1aab65dbull, 0xc45d1df942711d9aull,
+    0x924d692ca61be758ull, 0xda01ee641a708deaull, 0xa26da3999aef774aull, 0xf209787bb47d6b85ull,
+    0xb454e4a179dd1877ull, 0x865b86925b9bc5c2ull, 0xc83553c5c8965d3dull, 0x952ab45cfa97a0b3ull,
+    0xde469fbd99a05fe3ull, 0xa59bc234db398c25ull, 0xf6c69a72a3989f5cull, 0xb7dcbf5354e9beceull,
+    0x88fcf317f22241e2ull, 0xcc20ce9bd35c78a5ull, 0x98165af37b2153dfull, 0xe2a0b5dc971f303aull,
+    0xa8d9d1535ce3b396ull, 0xfb9b7cd9a4a7443cull, 0xbb764c4ca7a44410ull, 0x8bab8eefb6409c1aull,
+    0xd01fef10a657842cull, 0x9b10a4e5e9913129ull, 0xe7109bfba19c0c9dull, 0xac2820d9623bf429ull,
+    0x80444b5e7aa7cf85ull, 0xbf21e44003acdd2dull, 0x8e679c2f5e44ff8full, 0xd433179d9c8cb841ull,
+    0x9e19db92b4e31ba9ull, 0xeb96bf6ebadf77d9ull, 0xaf87023b9bf0ee6bull
+};
+
+static const int16_t xjson_cached_powers_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954,
+    -927, -901, -874, -847, -821, -794, -768, -741, -715, -688, -661,
+    -635, -608, -582, -555, -529, -502, -475, -449, -422, -396, -369,
+    -343, -316, -289, -263, -236, -210, -183, -157, -130, -103, -77,
+    -50, -24, 3, 30, 56, 83, 109, 136, 162, 189, 216,
+    242, 269, 295, 322, 348, 375, 402, 428, 455, 481, 508,
+    534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800,
+    827, 853, 880, 907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const uint64_t xjson_powers_of_ten_u64[] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull, 
+    1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull, 
+    100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull, 
+    1000000000000000000ull, 10000000000000000000ull
+};
+
+xjson_diy_fp xjson_diy_fp_normalize(xjson_diy_fp value)
+{
+    int shift = xjson_clz64(value.f);
+    value.f <<= shift;
+    value.e -= shift;
+    return value;
+}
+
+xjson_diy_fp xjson_diy_fp_multiply(xjson_diy_fp a, xjson_diy_fp b)
+{
+    xjson_u128 product = xjson_multiply_u64(a.f, b.f);
+    xjson_diy_fp result;
+    // Keep the upper half, rounded
+    result.f = product.high + (product.low >> 63);
+    result.e = a.e + b.e + 64;
+    return result;
+}
+
+/* Returns the cached power of ten c so that e + c.e + 64 lands in [-60, -32], and its decimal exponent -k */
+xjson_diy_fp xjson_cached_power(int e, int* k)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int ik = (int)dk;
+    if(dk - ik > 0.0) ik++;
+
+    unsigned index = (unsigned)((ik >> 3) + 1);
+    *k = -(-348 + (int)(index << 3));
+
+    xjson_diy_fp power = { xjson_cached_powers_f[index], xjson_cached_powers_e[index] };
+    return power;
+}
+
+/* Moves the last digit closer to w as long as it stays within the rounding interval */
+void xjson_grisu_round(char* buffer, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+    while(rest < wp_w && delta - rest >= ten_kappa &&
+        (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+    {
+        buffer[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+/* Generates the digits of w that lie within delta below mp. Returns the digit count and adds to the decimal exponent k */
+int xjson_grisu_digits(xjson_diy_fp w, xjson_diy_fp mp, uint64_t delta, char* buffer, int* k)
+{
+    const xjson_diy_fp one = { (uint64_t)1 << -mp.e, mp.e };
+    const uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = xjson_count_digits(p1);
+    int len = 0;
+
+    // Integral part
+    while(kappa > 0)
+    {
+        uint32_t divisor = (uint32_t)xjson_powers_of_ten_u64[kappa - 1];
+        uint32_t digit = p1 / divisor;
+        p1 %= divisor;
+        if(digit || len) buffer[len++] = (char)('0' + digit);
+        kappa--;
+
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if(rest <= delta)
+        {
+            *k += kappa;
+            xjson_grisu_round(buffer, len, delta, rest, xjson_powers_of_ten_u64[kappa] << -one.e, wp_w);
+            return len;
+        }
+    }
+
+    // Fractional part
+    for(;;)
+    {
+        p2 *= 10;
+        delta *= 10;
+        char digit = (char)(p2 >> -one.e);
+        if(digit || len) buffer[len++] = (char)('0' + digit);
+        p2 &= one.f - 1;
+        kappa--;
+
+        if(p2 < delta)
+        {
+            *k += kappa;
+            int index = -kappa;
+            xjson_grisu_round(buffer, len, delta, p2, one.f, wp_w * (index < 20 ? xjson_powers_of_ten_u64[index] : 0));
+            return len;
+        }
+    }
+}
+
+/* Writes a decimal exponent, e.g. "-7" or "308" */
+int xjson_format_exponent(char* buffer, int exponent)
+{
+    int len = 0;
+    if(exponent < 0)
+    {
+        buffer[len++] = '-';
+        exponent = -exponent;
+    }
+    if(exponent >= 100) buffer[len++] = (char)('0' + exponent / 100);
+    if(exponent >= 10) buffer[len++] = (char)('0' + exponent / 10 % 10);
+    buffer[len++] = (char)('0' + exponent % 10);
+    return len;
+}
+
+/* Writes the positive, finite value (given as bits without the sign) with the shortest digits that read back 
+   to the same value of the given format. Returns the length, buffer needs XJSON_FLOAT_MAX_LENGTH bytes. */
+int xjson_format_float(char* buffer, uint64_t bits, const xjson_float_format* format)
+{
+    uint64_t hidden_bit = (uint64_t)1 << format->mantissa_bits;
+    uint64_t significand = bits & (hidden_bit - 1);
+    int biased_exponent = (int)(bits >> format->mantissa_bits);
+
+    if(biased_exponent == 0 && significand == 0)
+    {
+        memcpy(buffer, "0.0", 3);
+        return 3;
+    }
+
+    xjson_diy_fp v;
+    if(biased_exponent != 0)
+    {
+        v.f = significand + hidden_bit;
+        v.e = biased_exponent + format->minimum_exponent - format->mantissa_bits;
+    }
+    else
+    {
+        v.f = significand;
+        v.e = 1 + format->minimum_exponent - format->mantissa_bits;
+    }
+
+    // The rounding interval of v, the lower boundary is closer at powers of two
+    xjson_diy_fp plus = { (v.f << 1) + 1, v.e - 1 };
+    plus = xjson_diy_fp_normalize(plus);
+    xjson_diy_fp minus;
+    if(v.f == hidden_bit)
+    {
+        minus.f = (v.f << 2) - 1;
+        minus.e = v.e - 2;
+    }
+    else
+    {
+        minus.f = (v.f << 1) - 1;
+        minus.e = v.e - 1;
+    }
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    // Scale everything by a power of ten and narrow the interval to account for the imprecision
+    int k;
+    xjson_diy_fp c = xjson_cached_power(plus.e, &k);
+    xjson_diy_fp w = xjson_diy_fp_multiply(xjson_diy_fp_normalize(v), c);
+    xjson_diy_fp wp = xjson_diy_fp_multiply(plus, c);
+    xjson_diy_fp wm = xjson_diy_fp_multiply(minus, c);
+    wm.f++;
+    wp.f--;
+
+    int length = xjson_grisu_digits(w, wp, wp.f - wm.f, buffer, &k);
+
+    // Lay out the digits, value is digits * 10^k and 10^(kk-1) <= value < 10^kk. From 1e16 on, integral values 
+    // would be padded with zeros beyond the precision of a double, so they are written with an exponent
+    int kk = length + k;
+    if(k >= 0 && kk <= 16)
+    {
+        // 1234e7 -> 12340000000.0
+        for(int i = length; i < kk; i++) buffer[i] = '0';
+        buffer[kk] = '.';
+        buffer[kk + 1] = '0';
+        return kk + 2;
+    }
+    else if(k < 0 && kk > 0)
+    {
+        // 1234e-2 -> 12.34
+        memmove(&buffer[kk + 1], &buffer[kk], length - kk);
+        buffer[kk] = '.';
+        return length + 1;
+    }
+    else if(kk > -6 && kk <= 0)
+    {
+        // 1234e-6 -> 0.001234
+        int offset = 2 - kk;
+        memmove(&buffer[offset], &buffer[0], length);
+        buffer[0] = '0';
+        buffer[1] = '.';
+        for(int i = 2; i < offset; i++) buffer[i] = '0';
+        return length + offset;
+    }
+    else if(length == 1)
+    {
+        // 1e30
+        buffer[1] = 'e';
+        return 2 + xjson_format_exponent(&buffer[2], kk - 1);
+    }
+    else
+    {
+        // 1234e30 -> 1.234e33
+        memmove(&buffer[2], &buffer[1], length - 1);
+        buffer[1] = '.';
+        buffer[length + 1] = 'e';
+        return length + 2 + xjson_format_exponent(&buffer[length + 2], kk - 1);
+    }
+}
+
+/* Prints a float/double given as its bits. Formats straight into the output if there's enough room left */
+void xjson_print_float_bits(xjson* json, uint64_t bits, bool negative, const xjson_float_format* format)
+{
+    if(json->error) return;
+
+    if((int)(bits >> format->mantissa_bits) == format->infinite_power)
+    {
+        xjson_error(json, "NaN and infinity can't be written as json.");
+        return;
+    }
+
+    if(xjson_has_room(json, XJSON_FLOAT_MAX_LENGTH))
+    {
+        if(negative) *json->current++ = '-';
+        json->current += xjson_format_float((char*)json->current, bits, format);
+    }
+    else
+    {
+        char buffer[XJSON_FLOAT_MAX_LENGTH];
+        int len = 0;
+        if(negative) buffer[len++] = '-';
+        len += xjson_format_float(buffer + len, bits, format);
+        xjson_print_token(json, buffer, len);
+    }
+}
+
+//----------------------------------------------------------------------------------
+// CBOR
+//
+// The same process functions can read/write CBOR (RFC 8949) instead of json, selected with xjson_set_format. 
+// Objects are maps with text string keys. As the number of members isn't known up front, objects and arrays are 
+// written with indefinite length and closed with a break byte, when reading both kinds of length are accepted.
+// Every data item starts with a head: the major type in the top 3 bits and the argument in the low 5 bits, 
+// followed by 1 to 8 big-endian bytes if the argument doesn't fit.
+//----------------------------------------------------------------------------------
+
+#define XJSON_CBOR_UNSIGNED 0
+#define XJSON_CBOR_NEGATIVE 1
+#define XJSON_CBOR_BYTES 2
+#define XJSON_CBOR_TEXT 3
+#define XJSON_CBOR_ARRAY 4
+#define XJSON_CBOR_MAP 5
+#define XJSON_CBOR_TAG 6
+#define XJSON_CBOR_SIMPLE 7
+
+#define XJSON_CBOR_FALSE 0xF4
+#define XJSON_CBOR_TRUE 0xF5
+#define XJSON_CBOR_HALF 0xF9
+#define XJSON_CBOR_FLOAT 0xFA
+#define XJSON_CBOR_DOUBLE 0xFB
+#define XJSON_CBOR_BREAK 0xFF
+
+typedef struct xjson_cbor_head
+{
+    uint8_t major;
+    // The low 5 bits of the first byte, 31 marks an indefinite length
+    uint8_t info;
+    uint64_t argument;
+} xjson_cbor_head;
+
+/* Parses the head of the data item at ptr. Returns a pointer past it, or NULL if it's malformed or truncated */
+const uint8_t* xjson_cbor_parse_head(const uint8_t* ptr, const uint8_t* end, xjson_cbor_head* head)
+{
+    if(ptr >= end) return NULL;
+
+    head->major = *ptr >> 5;
+    head->info = *ptr & 0x1F;
+    ptr++;
+
+    if(head->info < 24)
+    {
+        head->argument = head->info;
+        return ptr;
+    }
+    if(head->info == 31)
+    {
+        head->argument = 0;
+        return ptr;
+    }
+    if(head->info > 27) return NULL;
+
+    // 24..27 are followed by 1, 2, 4 or 8 bytes
+    size_t size = (size_t)1 << (head->info - 24);
+    if((size_t)(end - ptr) < size) return NULL;
+
+    uint64_t argument = 0;
+    for(size_t i=0; i<size; i++)
+    {
+        argument = (argument << 8) | ptr[i];
+    }
+    head->argument = argument;
+    return ptr + size;
+}
+
+/* Returns a pointer past the data item at ptr, including anything nested in it, or NULL if it's malformed */
+const uint8_t* xjson_cbor_skip_item(const uint8_t* ptr, const uint8_t* end, int depth)
+{
+    if(depth > XJSON_MAX_DEPTH) return NULL;
+
+    xjson_cbor_head head;
+    ptr = xjson_cbor_parse_head(ptr, end, &head);
+    if(ptr == NULL) return NULL;
+
+    switch(head.major)
+    {
+    case XJSON_CBOR_BYTES:
+    case XJSON_CBOR_TEXT:
+        if(head.info == 31)
+        {
+            // Indefinite strings are a list of definite chunks
+            while(ptr < end && *ptr != XJSON_CBOR_BREAK)
+            {
+                ptr = xjson_cbor_skip_item(ptr, end, depth + 1);
+                if(ptr == NULL) return NULL;
+            }
+            return ptr < end ? ptr + 1 : NULL;
+        }
+        if(head.argument > (uint64_t)(end - ptr)) return NULL;
+        return ptr + head.argument;
+    case XJSON_CBOR_ARRAY:
+    case XJSON_CBOR_MAP:
+        if(head.info == 31)
+        {
+            while(ptr < end && *ptr != XJSON_CBOR_BREAK)
+            {
+                ptr = xjson_cbor_skip_item(ptr, end, depth + 1);
+                if(ptr == NULL) return NULL;
+            }
+            return ptr < end ? ptr + 1 : NULL;
+        }
+        else
+        {
+            // Every item takes at least a byte, which also keeps a bogus count from looping for long
+            uint64_t items = head.argument;
+            if(items > (uint64_t)(end - ptr)) return NULL;
+            if(head.major == XJSON_CBOR_MAP) items *= 2;
+            for(uint64_t i=0; i<items && ptr != NULL; i++)
+            {
+                ptr = xjson_cbor_skip_item(ptr, end, depth + 1);
+            }
+            return ptr;
+        }
+    case XJSON_CBOR_TAG:
+        return xjson_cbor_skip_item(ptr, end, depth + 1);
+    case XJSON_CBOR_SIMPLE:
+        // A break is only valid at the end of an indefinite item
+        return head.info == 31 ? NULL : ptr;
+    default:
+        return ptr;
+    }
+}
+
+/* Parses the head at the current location and moves past it */
+void xjson_cbor_expect_head(xjson* json, xjson_cbor_head* head)
+{
+    if(json->error) return;
+
+    const uint8_t* next = xjson_cbor_parse_head(json->current, json->end, head);
+    if(next == NULL)
+    {
+        xjson_error(json, "Unexpected end of data found.");
+        return;
+    }
+    json->current = (uint8_t*)next;
+}
+
+/* Returns true if the current location is past the last member/element of the object/array in scope. Until a map 
+   has been scanned, the members/elements of a definite map/array are counted to know where it ends */
+bool xjson_cbor_reached_scope_end(xjson* json)
+{
+    if(json->intendation == 0) return json->current >= json->end;
+
+    xjson_scope* scope = &json->scopes[json->intendation - 1];
+    if(scope->end != 0) return json->current >= json->start + scope->end;
+    if(scope->indefinite) return json->current >= json->end || *json->current == XJSON_CBOR_BREAK;
+    return scope->read >= scope->count;
+}
+
+/* Checks whether the text string at ptr is key. Returns a pointer past the key if it is, NULL if it isn't */
+const uint8_t* xjson_cbor_match_key(xjson* json, const uint8_t* ptr, const char* key, size_t key_len)
+{
+    xjson_cbor_head head;
+    ptr = xjson_cbor_parse_head(ptr, json->end, &head);
+    if(ptr == NULL || head.major != XJSON_CBOR_TEXT || head.info == 31 || head.argument != key_len) return NULL;
+    if((size_t)(json->end - ptr) < key_len || memcmp(ptr, key, key_len) != 0) return NULL;
+    return ptr + key_len;
+}
+
+/* Scans all members of the map in scope like xjson_build_key_index and records where it ends. Only text keys 
+   of definite length are indexed, other keys can't match */
+void xjson_cbor_build_key_index(xjson* json, xjson_scope* scope)
+{
+    const uint8_t* ptr = json->start + scope->begin;
+    uint32_t count = 0;
+    bool fits = true;
+
+    for(uint64_t i=0; scope->indefinite ? ptr < json->end && *ptr != XJSON_CBOR_BREAK : i < scope->count; i++)
+    {
+        size_t offset = ptr - json->start;
+        xjson_cbor_head head;
+        const uint8_t* key_start = xjson_cbor_parse_head(ptr, json->end, &head);
+        const uint8_t* value = xjson_cbor_skip_item(ptr, json->end, json->intendation);
+        ptr = value != NULL ? xjson_cbor_skip_item(value, json->end, json->intendation) : NULL;
+        if(ptr == NULL) break;
+
+        if(head.major != XJSON_CBOR_TEXT || head.info == 31) continue;
+        if(offset > UINT32_MAX || !fits || !xjson_reserve_key_index(json, count + 1))
+        {
+            fits = false;
+        }
+        else
+        {
+            xjson_key_slot* slot = json->key_index + json->key_index_top + count;
+            slot->offset = (uint32_t)offset;
+            slot->hash = xjson_hash_key((const char*)key_start, (size_t)head.argument);
+        }
+        count++;
+    }
+
+    if(ptr == NULL || (scope->indefinite && ptr >= json->end))
+    {
+        xjson_error(json, "Malformed data found.");
+        return;
+    }
+
+    scope->end = ptr - json->start;
+    scope->scanned = true;
+    xjson_hash_key_index(json, scope, count, fits);
+}
+
+/* Looks up key in the map in scope, the map is scanned on the first lookup. hash is the key's hash if it's known 
+   already, otherwise NULL. Returns a pointer to the value, or NULL if the map doesn't contain the key */
+const uint8_t* xjson_cbor_find_key(xjson* json, xjson_scope* scope, const char* key, size_t key_len, const uint32_t* key_hash)
+{
+    if(!scope->scanned)
+    {
+        xjson_cbor_build_key_index(json, scope);
+        if(json->error) return NULL;
+    }
+
+    if(scope->index_mask != 0)
+    {
+        xjson_key_slot* table = json->key_index + scope->index_base;
+        uint32_t hash = key_hash != NULL ? *key_hash : xjson_hash_key(key, key_len);
+        for(uint32_t slot = hash & scope->index_mask; table[slot].offset != 0; slot = (slot + 1) & scope->index_mask)
+        {
+            if(table[slot].hash != hash) continue;
+            const uint8_t* value = xjson_cbor_match_key(json, json->start + table[slot].offset, key, key_len);
+            if(value != NULL) return value;
+        }
+        return NULL;
+    }
+
+    // No hash table, walk all the members. The scan made sure they are well-formed
+    const uint8_t* scope_end = json->start + scope->end;
+    const uint8_t* ptr = json->start + scope->begin;
+    while(ptr < scope_end)
+    {
+        const uint8_t* value = xjson_cbor_match_key(json, ptr, key, key_len);
+        if(value != NULL) return value;
+        ptr = xjson_cbor_skip_item(xjson_cbor_skip_item(ptr, scope_end, 0), scope_end, 0);
+    }
+    return NULL;
+}
+
+/* The CBOR version of xjson_read_key_hashed. Keys may appear in any order, the next member is checked first, 
+   then the key index of the map */
+bool xjson_cbor_read_key_len(xjson* json, const char* key, size_t key_len, const uint32_t* hash)
+{
+    if(json->error || json->missing_depth > 0) return false;
+
+    xjson_scope* scope = json->intendation > 0 ? &json->scopes[json->intendation - 1] : NULL;
+    if(key == NULL)
+    {
+        if(scope != NULL && scope->is_array) scope->read++;
+        return true;
+    }
+
+    if(scope == NULL || scope->is_array)
+    {
+        xjson_error(json, "Expected key does not match.");
+        return false;
+    }
+
+    const uint8_t* value = !xjson_cbor_reached_scope_end(json) ? xjson_cbor_match_key(json, json->current, key, key_len) : NULL;
+    if(value != NULL)
+    {
+        scope->read++;
+    }
+    else
+    {
+        value = xjson_cbor_find_key(json, scope, key, key_len, hash);
+        if(value == NULL) return false;
+    }
+    json->current = (uint8_t*)value;
+    XJSON_STATS_KEY(json);
+    return true;
+}
+
+bool xjson_cbor_read_key(xjson* json, const char* key)
+{
+    return xjson_cbor_read_key_len(json, key, key != NULL ? strlen(key) : 0, NULL);
+}
+
+/* Opens a map/array scope in read mode. Where it ends isn't worked out until it's needed, skipping over it 
+   right away would visit nested data once per level */
+void xjson_cbor_push_scope(xjson* json, uint8_t major)
+{
+    xjson_cbor_head head;
+    xjson_cbor_expect_head(json, &head);
+    if(json->error) return;
+
+    if(head.major != major)
+    {
+        xjson_error(json, "Unexpected token found.");
+        return;
+    }
+    if(json->intendation >= XJSON_MAX_DEPTH)
+    {
+        xjson_error(json, "Maximum nesting depth exceeded.");
+        return;
+    }
+    // Every item takes at least a byte, which also keeps a bogus count from looping for long
+    if(head.argument > (uint64_t)(json->end - json->current))
+    {
+        xjson_error(json, "Malformed data found.");
+        return;
+    }
+
+    xjson_scope* scope = &json->scopes[json->intendation];
+    scope->begin = json->current - json->start;
+    scope->end = 0;
+    scope->index_base = json->key_index_top;
+    scope->index_mask = 0;
+    scope->is_array = major == XJSON_CBOR_ARRAY;
+    scope->scanned = false;
+    scope->indefinite = head.info == 31;
+    scope->count = head.argument;
+    scope->read = 0;
+}
+
+/* Moves past the end of the map/array in scope, skipping whatever hasn't been read */
+void xjson_cbor_pop_scope(xjson* json)
+{
+    xjson_scope* scope = &json->scopes[json->intendation];
+    const uint8_t* ptr = json->current;
+    if(scope->end != 0)
+    {
+        ptr = json->start + scope->end;
+    }
+    else if(scope->indefinite)
+    {
+        while(ptr != NULL && ptr < json->end && *ptr != XJSON_CBOR_BREAK)
+        {
+            ptr = xjson_cbor_skip_item(ptr, json->end, json->intendation + 1);
+        }
+    }
+    else
+    {
+        // Without a scan, everything up to current has been read in order
+        uint64_t items = scope->count - scope->read;
+        if(!scope->is_array) items *= 2;
+        for(uint64_t i=0; i<items && ptr != NULL; i++)
+        {
+            ptr = xjson_cbor_skip_item(ptr, json->end, json->intendation + 1);
+        }
+    }
+
+    if(ptr == NULL || (scope->indefinite && ptr >= json->end))
+    {
+        xjson_error(json, "Malformed data found.");
+        return;
+    }
+    json->current = (uint8_t*)ptr + (scope->indefinite ? 1 : 0);
+}
+
+void xjson_cbor_expect_int(xjson* json, uint64_t* magnitude, bool* negative)
+{
+    xjson_cbor_head head;
+    xjson_cbor_expect_head(json, &head);
+    if(json->error) return;
+
+    if(head.major == XJSON_CBOR_UNSIGNED)
+    {
+        *magnitude = head.argument;
+        *negative = false;
+    }
+    else if(head.major == XJSON_CBOR_NEGATIVE && head.argument != UINT64_MAX)
+    {
+        // Negative integers are stored as -1 - argument
+        *magnitude = head.argument + 1;
+        *negative = true;
+    }
+    else if(head.major == XJSON_CBOR_NEGATIVE)
+    {
+        xjson_error(json, "Integer value out of range.");
+    }
+    else
+    {
+        xjson_error(json, "Unexpected token whilst parsing integer.");
+    }
+}
+
+/* Converts the bits of a half-precision float into a float */
+float xjson_half_to_float(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half >> 15) << 31;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+
+    float value;
+    if(exponent == 0)
+    {
+        // Subnormal, exactly representable as a float
+        value = (float)mantissa * (1.0f / 16777216.0f);
+        return sign ? -value : value;
+    }
+
+    uint32_t bits = sign | (mantissa << 13);
+    bits |= exponent == 31 ? 0x7F800000u : (exponent - 15 + 127) << 23;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/* Reads any number as a double, integers are converted */
+void xjson_cbor_expect_double(xjson* json, double* val)
+{
+    if(json->error) return;
+
+    uint8_t initial = json->current < json->end ? *json->current : 0;
+    if(initial == XJSON_CBOR_HALF || initial == XJSON_CBOR_FLOAT || initial == XJSON_CBOR_DOUBLE)
+    {
+        xjson_cbor_head head;
+        xjson_cbor_expect_head(json, &head);
+        if(json->error) return;
+
+        if(initial == XJSON_CBOR_HALF)
+        {
+            *val = xjson_half_to_float((uint16_t)head.argument);
+        }
+        else if(initial == XJSON_CBOR_FLOAT)
+        {
+            uint32_t bits = (uint32_t)head.argument;
+            float value;
+            memcpy(&value, &bits, sizeof(value));
+            *val = value;
+        }
+        else
+        {
+            memcpy(val, &head.argument, sizeof(*val));
+        }
+        return;
+    }
+
+    uint64_t magnitude;
+    bool negative;
+    xjson_cbor_expect_int(json, &magnitude, &negative);
+    if(json->error) return;
+    *val = negative ? -(double)magnitude : (double)magnitude;
+}
+
+/* Reads the text string at the current location, str points into the data */
+void xjson_cbor_expect_string(xjson* json, const uint8_t** str, size_t* len)
+{
+    xjson_cbor_head head;
+    xjson_cbor_expect_head(json, &head);
+    if(json->error) return;
+
+    if(head.major != XJSON_CBOR_TEXT)
+    {
+        xjson_error(json, "Unexpected token whilst parsing string.");
+        return;
+    }
+    if(head.info == 31)
+    {
+        xjson_error(json, "Indefinite length strings are not supported.");
+        return;
+    }
+    if(head.argument > (uint64_t)(json->end - json->current))
+    {
+        xjson_error(json, "Unexpected end of data found.");
+        return;
+    }
+
+    *str = json->current;
+    *len = (size_t)head.argument;
+    json->current += head.argument;
+}
+
+/* Writes a head with the argument in as few bytes as possible */
+void xjson_cbor_print_head(xjson* json, uint8_t major, uint64_t argument)
+{
+    uint8_t buffer[9];
+    size_t size = 0;
+    if(argument < 24) size = 0;
+    else if(argument <= UINT8_MAX) size = 1;
+    else if(argument <= UINT16_MAX) size = 2;
+    else if(argument <= UINT32_MAX) size = 4;
+    else size = 8;
+
+    // 1, 2, 4 and 8 bytes are marked by 24..27
+    static const uint8_t size_info[] = { 0, 24, 25, 0, 26, 0, 0, 0, 27 };
+    buffer[0] = (uint8_t)(major << 5) | (size == 0 ? (uint8_t)argument : size_info[size]);
+    for(size_t i=0; i<size; i++)
+    {
+        buffer[1 + i] = (uint8_t)(argument >> ((size - 1 - i) * 8));
+    }
+    xjson_print_token(json, (const char*)buffer, 1 + size);
+}
+
+void xjson_cbor_print_byte(xjson* json, uint8_t byte)
+{
+    xjson_print_token(json, (const char*)&byte, 1);
+}
+
+/* Writes the key of the next value, if it wasn't written by xjson_key already */
+void xjson_cbor_print_value_prefix_len(xjson* json, const char* key, size_t key_len)
+{
+    if(json->error) return;
+
+    if(json->after_key)
+    {
+        json->after_key = false;
+        return;
+    }
+    if(key != NULL)
+    {
+        xjson_cbor_print_head(json, XJSON_CBOR_TEXT, key_len);
+        xjson_print_token(json, key, key_len);
+        XJSON_STATS_KEY(json);
+    }
+}
+
+void xjson_cbor_print_value_prefix(xjson* json, const char* key)
+{
+    xjson_cbor_print_value_prefix_len(json, key, key != NULL ? strlen(key) : 0);
+}
+
+void xjson_cbor_print_float(xjson* json, uint8_t initial, uint64_t bits, size_t size)
+{
+    uint8_t buffer[9];
+    buffer[0] = initial;
+    for(size_t i=0; i<size; i++)
+    {
+        buffer[1 + i] = (uint8_t)(bits >> ((size - 1 - i) * 8));
+    }
+    xjson_print_token(json, (const char*)buffer, 1 + size);
+}
+
+/* Closes an object/array, at the root the sink receives the rest of the output */
+void xjson_cbor_print_scope_end(xjson* json)
+{
+    xjson_cbor_print_byte(json, XJSON_CBOR_BREAK);
+    xjson_cache_scope_end(json);
+    if(json->intendation == 0) xjson_print_document_end(json);
+}
+
+void xjson_cbor_begin(xjson* json, const char* key, uint8_t major)
+{
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(!xjson_cbor_read_key(json, key))
+        {
+            if(!json->error) json->missing_depth += 1;
+        }
+        else
+        {
+            xjson_cbor_push_scope(json, major);
+        }
+    }
+    else
+    {
+        xjson_cbor_print_value_prefix(json, key);
+        xjson_cbor_print_byte(json, (uint8_t)(major << 5) | 31);
+    }
+    json->intendation += 1;
+}
+
+void xjson_cbor_end(xjson* json, uint8_t major)
+{
+    json->intendation -= 1;
+
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(json->missing_depth > 0)
+        {
+            json->missing_depth -= 1;
+            return;
+        }
+        xjson_cbor_pop_scope(json);
+    }
+    else
+    {
+        xjson_cbor_print_scope_end(json);
+    }
+    XJSON_STATS_SCOPE_END(json, major == XJSON_CBOR_MAP ? XJSON_VALUE_OBJECT : XJSON_VALUE_ARRAY);
+}
+
+void xjson_cbor_integer(xjson* json, const char* key, void* val, xjson_int_type type)
+{
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(!xjson_cbor_read_key(json, key)) return;
+
+        uint64_t magnitude;
+        bool negative;
+        xjson_cbor_expect_int(json, &magnitude, &negative);
+        if(json->error) return;
+        xjson_store_integer(json, val, type, magnitude, negative);
+    }
+    else
+    {
+        xjson_cbor_print_value_prefix(json, key);
+
+        bool negative;
+        uint64_t magnitude = xjson_load_integer(val, type, &negative);
+        xjson_cbor_print_head(json, negative ? XJSON_CBOR_NEGATIVE : XJSON_CBOR_UNSIGNED, negative ? magnitude - 1 : magnitude);
+    }
+    XJSON_STATS_VALUE(json, XJSON_VALUE_INTEGER, 1);
+}
+
+void xjson_cbor_float(xjson* json, const char* key, float* val)
+{
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(!xjson_cbor_read_key(json, key)) return;
+
+        double value;
+        xjson_cbor_expect_double(json, &value);
+        if(!json->error) *val = (float)value;
+    }
+    else
+    {
+        xjson_cbor_print_value_prefix(json, key);
+
+        uint32_t bits;
+        memcpy(&bits, val, sizeof(bits));
+        xjson_cbor_print_float(json, XJSON_CBOR_FLOAT, bits, 4);
+    }
+    XJSON_STATS_VALUE(json, XJSON_VALUE_FLOAT, 1);
+}
+
+void xjson_cbor_double(xjson* json, const char* key, double* val)
+{
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(!xjson_cbor_read_key(json, key)) return;
+        xjson_cbor_expect_double(json, val);
+    }
+    else
+    {
+        xjson_cbor_print_value_prefix(json, key);
+
+        // Doubles that fit into a float without losing anything are written as one, which halves their size
+        float single = (float)*val;
+        if((double)single == *val)
+        {
+            uint32_t bits;
+            memcpy(&bits, &single, sizeof(bits));
+            xjson_cbor_print_float(json, XJSON_CBOR_FLOAT, bits, 4);
+        }
+        else
+        {
+            uint64_t bits;
+            memcpy(&bits, val, sizeof(bits));
+            xjson_cbor_print_float(json, XJSON_CBOR_DOUBLE, bits, 8);
+        }
+    }
+    XJSON_STATS_VALUE(json, XJSON_VALUE_FLOAT, 1);
+}
+
+void xjson_cbor_bool(xjson* json, const char* key, bool* val)
+{
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(!xjson_cbor_read_key(json, key)) return;
+
+        uint8_t initial = json->current < json->end ? *json->current : 0;
+        if(initial != XJSON_CBOR_TRUE && initial != XJSON_CBOR_FALSE)
+        {
+            xjson_error(json, "Unexpected token whilst parsing bool.");
+            return;
+        }
+        *val = initial == XJSON_CBOR_TRUE;
+        json->current++;
+    }
+    else
+    {
+        xjson_cbor_print_value_prefix(json, key);
+        xjson_cbor_print_byte(json, *val ? XJSON_CBOR_TRUE : XJSON_CBOR_FALSE);
+    }
+    XJSON_STATS_VALUE(json, XJSON_VALUE_BOOL, 1);
+}
+
+/* Reads/writes a text string at current. When reading, str points into the data if allocate is false, otherwise it's allocated */
+void xjson_cbor_text(xjson* json, const char** str, size_t* len, bool allocate)
+{
+    if(json->mode == XJSON_STATE_READ)
+    {
+        const uint8_t* str_start;
+        size_t str_len;
+        xjson_cbor_expect_string(json, &str_start, &str_len);
+        if(json->error) return;
+
+        // Strings aren't escaped in CBOR, so a view never needs the allocator
+        if(allocate)
+        {
+            *str = xjson_allocate_string(json, str_start, str_len, false, &str_len);
+        }
+        else
+        {
+            *str = (const char*)str_start;
+        }
+        if(len != NULL) *len = str_len;
+    }
+    else
+    {
+        size_t str_len = len != NULL ? *len : strlen(*str);
+        xjson_cbor_print_head(json, XJSON_CBOR_TEXT, str_len);
+        xjson_print_token(json, *str, str_len);
+    }
+}
+
+void xjson_cbor_string(xjson* json, const char* key, const char** str, size_t* len, bool allocate)
+{
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(!xjson_cbor_read_key(json, key)) return;
+    }
+    else
+    {
+        xjson_cbor_print_value_prefix(json, key);
+    }
+    xjson_cbor_text(json, str, len, allocate);
+    XJSON_STATS_VALUE(json, XJSON_VALUE_STRING, 1);
+}
+
+void xjson_cbor_key(xjson* json, const char** key, size_t* len, bool allocate)
+{
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(json->error || json->missing_depth > 0) return;
+        xjson_cbor_text(json, key, len, allocate);
+
+        // The value follows without key, so the member is counted here
+        if(json->intendation > 0) json->scopes[json->intendation - 1].read++;
+    }
+    else
+    {
+        xjson_cbor_text(json, key, len, allocate);
+        json->after_key = true;
+    }
+    XJSON_STATS_KEY(json);
+}
+
+void xjson_cbor_skip_value(xjson* json, const char* key)
+{
+    if(json->mode != XJSON_STATE_READ || !xjson_cbor_read_key(json, key)) return;
+
+    const uint8_t* next = xjson_cbor_skip_item(json->current, json->end, json->intendation);
+    if(next == NULL)
+    {
+        xjson_error(json, "Malformed data found.");
+        return;
+    }
+    json->current = (uint8_t*)next;
+}
+
+/* Reads/writes an array of numbers. As the count is known up front, it's written with definite length */
+void xjson_cbor_number_array(xjson* json, const char* key, void* vals, size_t capacity, size_t* count, int type)
+{
+    size_t size = xjson_number_size[type];
+    uint8_t* val = (uint8_t*)vals;
+
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(!xjson_cbor_read_key(json, key)) return;
+
+        xjson_cbor_head head;
+        xjson_cbor_expect_head(json, &head);
+        if(json->error) return;
+        if(head.major != XJSON_CBOR_ARRAY)
+        {
+            xjson_error(json, "Unexpected token found.");
+            return;
+        }
+
+        size_t read = 0;
+        while(!json->error)
+        {
+            if(head.info == 31 ? json->current < json->end && *json->current == XJSON_CBOR_BREAK : read == head.argument)
+                break;
+            if(read >= capacity)
+            {
+                xjson_error(json, "Array has more values than fit.");
+                return;
+            }
+
+            if(type == XJSON_NUMBER_TYPE_FLOAT)
+                xjson_cbor_float(json, NULL, (float*)val);
+            else if(type == XJSON_NUMBER_TYPE_DOUBLE)
+                xjson_cbor_double(json, NULL, (double*)val);
+            else
+                xjson_cbor_integer(json, NULL, val, (xjson_int_type)type);
+            val += size;
+            read++;
+        }
+        if(json->error) return;
+
+        if(head.info == 31) json->current++;
+        if(count != NULL) *count = read;
+    }
+    else
+    {
+        size_t write = count != NULL ? *count : capacity;
+        XJSON_ASSERT(write <= capacity);
+
+        xjson_cbor_print_value_prefix(json, key);
+        xjson_cbor_print_head(json, XJSON_CBOR_ARRAY, write);
+        for(size_t i=0; i<write && !json->error; i++, val += size)
+        {
+            if(type == XJSON_NUMBER_TYPE_FLOAT)
+                xjson_cbor_float(json, NULL, (float*)val);
+            else if(type == XJSON_NUMBER_TYPE_DOUBLE)
+                xjson_cbor_double(json, NULL, (double*)val);
+            else
+                xjson_cbor_integer(json, NULL, val, (xjson_int_type)type);
+        }
+        if(json->intendation == 0 && json->flush != NULL) xjson_flush(json);
+    }
+    XJSON_STATS_SCOPE_END(json, XJSON_VALUE_ARRAY);
+}
+
+void xjson_setup_read(xjson* json, const char* str, size_t len)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(str);
+
+    json->start = (uint8_t*)str;
+    json->current = (uint8_t*)str;
+    json->end = (uint8_t*)(str+len);
+    json->mode = XJSON_STATE_READ;
+    json->format = XJSON_FORMAT_JSON;
+    json->intendation = 0;
+    json->key_index_top = 0;
+    json->missing_depth = 0;
+    json->tape = NULL;
+    json->tape_count = 0;
+    json->tape_cursor = 0;
+    xjson_cache_abort(json);
+    XJSON_STATS_MARK(json);
+
+    if(json->string_allocator == NULL) json->string_allocator = xjson_malloc_string;
+}
+
+bool xjson_setup_read_indexed(xjson* json, const char* str, size_t len, xjson_tape_entry* tape, size_t tape_capacity)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(tape);
+
+    xjson_setup_read(json, str, len);
+
+    int64_t count = xjson_build_tape((const uint8_t*)str, len, tape, tape_capacity);
+    if(count < 0) return false;
+
+    json->tape = tape;
+    json->tape_count = (uint32_t)count;
+    return true;
+}
+
+void xjson_setup_write(xjson* json, bool pretty_print, char* buffer, size_t len)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(buffer);
+
+    json->pretty_print = pretty_print;
+    json->start = (uint8_t*)buffer;
+    json->current = (uint8_t*)buffer;
+    json->end = (uint8_t*)(buffer+len);
+    json->mode = XJSON_STATE_WRITE;
+    json->format = XJSON_FORMAT_JSON;
+    json->intendation = 0;
+    json->needs_comma = false;
+    json->after_key = false;
+    json->flush = NULL;
+    xjson_cache_abort(json);
+    XJSON_STATS_MARK(json);
+}
+
+void xjson_setup_write_sink(xjson* json, bool pretty_print, bool (*flush)(const char* data, size_t len, void* user), void* user)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(flush);
+
+    xjson_setup_write(json, pretty_print, (char*)json->sink_chunk, XJSON_SINK_CHUNK_SIZE);
+    json->flush = flush;
+    json->flush_user = user;
+}
+
+void xjson_setup_measure(xjson* json, bool pretty_print)
+{
+    XJSON_ASSERT(json);
+
+    // No buffer, so every write goes through xjson_print_token which only counts
+    json->pretty_print = pretty_print;
+    json->start = NULL;
+    json->current = NULL;
+    json->end = NULL;
+    json->mode = XJSON_STATE_MEASURE;
+    json->format = XJSON_FORMAT_JSON;
+    json->intendation = 0;
+    json->needs_comma = false;
+    json->after_key = false;
+    json->flush = NULL;
+    json->measure_size = 0;
+    xjson_cache_abort(json);
+    XJSON_STATS_MARK(json);
+}
+
+bool xjson_setup_read_file(xjson* json, const char* path)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(path);
+
+    json->file_data = NULL;
+    json->file_size = 0;
+    json->file_mapping = NULL;
+
+    // Errors below are reported before there is a document, so don't let them point into the previous one
+    json->mode = XJSON_STATE_UNITIALIZED;
+    json->start = NULL;
+    json->current = NULL;
+    json->end = NULL;
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        xjson_error(json, "Failed to open file.");
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    void* data = NULL;
+    if(GetFileSizeEx(file, &size) && size.QuadPart > 0)
+    {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(mapping != NULL) data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    // The mapping keeps the file open
+    CloseHandle(file);
+
+    if(data == NULL)
+    {
+        if(mapping != NULL) CloseHandle(mapping);
+        xjson_error(json, "Failed to map file.");
+        return false;
+    }
+    json->file_mapping = mapping;
+    json->file_size = (size_t)size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        xjson_error(json, "Failed to open file.");
+        return false;
+    }
+
+    struct stat info;
+    void* data = MAP_FAILED;
+    if(fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping keeps the file open
+    close(fd);
+
+    if(data == MAP_FAILED)
+    {
+        xjson_error(json, "Failed to map file.");
+        return false;
+    }
+    json->file_size = (size_t)info.st_size;
+
+    // The parser only moves forward, so let the kernel read ahead aggressively
+#if defined(POSIX_MADV_SEQUENTIAL)
+    posix_madvise(data, json->file_size, POSIX_MADV_SEQUENTIAL);
+#elif defined(MADV_SEQUENTIAL)
+    madvise(data, json->file_size, MADV_SEQUENTIAL);
+#endif
+#if defined(MADV_HUGEPAGE)
+    madvise(data, json->file_size, MADV_HUGEPAGE);
+#endif
+#endif
+
+    // There is no zero-terminator at the end of the mapping, the parser never reads past end
+    json->file_data = data;
+    xjson_setup_read(json, (const char*)data, json->file_size);
+    return true;
+}
+
+void xjson_close_file(xjson* json)
+{
+    XJSON_ASSERT(json);
+    if(json->file_data == NULL) return;
+
+#if defined(_WIN32)
+    UnmapViewOfFile(json->file_data);
+    CloseHandle((HANDLE)json->file_mapping);
+#else
+    munmap(json->file_data, json->file_size);
+#endif
+
+    json->file_data = NULL;
+    json->file_size = 0;
+    json->file_mapping = NULL;
+}
+
+void xjson_free(xjson* json)
+{
+    XJSON_ASSERT(json);
+
+    XJSON_FREE(json->key_index);
+    json->key_index = NULL;
+    json->key_index_top = 0;
+    json->key_index_capacity = 0;
+}
+
+void xjson_set_string_allocator(xjson* json, char* (*string_allocator)(const char* str, size_t size, void* mem_ctx))
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(string_allocator);
+
+    json->string_allocator = string_allocator;
+}
+
+char* xjson_malloc_string(const char* str, size_t size, void* mem_ctx)
+{
+    (void)mem_ctx;
+    char* new_str = (char*)XJSON_MALLOC(size + 1);
+    if(new_str == NULL) return NULL;
+
+    memcpy(new_str, str, size);
+    new_str[size] = '\0';
+    return new_str;
+}
+
+struct xjson_arena_block
+{
+    xjson_arena_block* next;
+    size_t size;
+    size_t used;
+    // Followed by size bytes of memory
+};
+
+void xjson_arena_init(xjson_arena* arena, size_t block_size)
+{
+    XJSON_ASSERT(arena);
+    XJSON_ASSERT(block_size > 0);
+
+    arena->blocks = NULL;
+    arena->block_size = block_size;
+    arena->used = 0;
+    arena->high_water_mark = 0;
+    arena->reserved = 0;
+}
+
+void xjson_arena_free(xjson_arena* arena)
+{
+    XJSON_ASSERT(arena);
+
+    xjson_arena_block* block = arena->blocks;
+    while(block != NULL)
+    {
+        xjson_arena_block* next = block->next;
+        XJSON_FREE(block);
+        block = next;
+    }
+
+    arena->blocks = NULL;
+    arena->used = 0;
+    arena->reserved = 0;
+}
+
+void xjson_arena_reset(xjson_arena* arena)
+{
+    XJSON_ASSERT(arena);
+
+    if(arena->blocks != NULL && arena->blocks->next != NULL)
+    {
+        // The last document didn't fit one block. Replace them with a single block big enough for it, so the next one will.
+        if(arena->block_size < arena->high_water_mark) arena->block_size = arena->high_water_mark;
+        xjson_arena_free(arena);
+    }
+    else if(arena->blocks != NULL)
+    {
+        arena->blocks->used = 0;
+    }
+    arena->used = 0;
+}
+
+char* xjson_arena_allocate_string(const char* str, size_t size, void* mem_ctx)
+{
+    xjson_arena* arena = (xjson_arena*)mem_ctx;
+    XJSON_ASSERT(arena);
+
+    // Strings are only ever accessed by byte, so there's nothing to align
+    size_t alloc_size = size + 1;
+    xjson_arena_block* block = arena->blocks;
+    if(block == NULL || block->size - block->used < alloc_size)
+    {
+        size_t block_size = alloc_size > arena->block_size ? alloc_size : arena->block_size;
+        xjson_arena_block* new_block = (xjson_arena_block*)XJSON_MALLOC(sizeof(xjson_arena_block) + block_size);
+        if(new_block == NULL) return NULL;
+
+        new_block->size = block_size;
+        new_block->used = 0;
+        arena->reserved += sizeof(xjson_arena_block) + block_size;
+
+        if(block != NULL && block_size > arena->block_size)
+        {
+            // An oversized string gets a block of its own, keep allocating from the current one
+            new_block->next = block->next;
+            block->next = new_block;
+        }
+        else
+        {
+            new_block->next = block;
+            arena->blocks = new_block;
+        }
+        block = new_block;
+    }
+
+    char* new_str = (char*)(block + 1) + block->used;
+    block->used += alloc_size;
+    arena->used += alloc_size;
+    if(arena->used > arena->high_water_mark) arena->high_water_mark = arena->used;
+
+    memcpy(new_str, str, size);
+    new_str[size] = '\0';
+    return new_str;
+}
+
+void xjson_set_arena(xjson* json, xjson_arena* arena)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(arena);
+
+    json->string_allocator = xjson_arena_allocate_string;
+    json->mem_ctx = arena;
+}
+
+void xjson_set_format(xjson* json, xjson_format format)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+
+    json->format = format;
+    // The structural index only knows json
+    json->tape = NULL;
+    json->tape_count = 0;
+}
+
+xjson_state xjson_get_state(xjson* json)
+{
+    XJSON_ASSERT(json);
+
+    return json->mode;
+}
+
+size_t xjson_get_size(xjson* json)
+{
+    XJSON_ASSERT(json);
+
+    if(json->mode == XJSON_STATE_MEASURE) return json->measure_size;
+    return json->current - json->start;
+}
+
+xjson_stats xjson_get_stats(xjson* json)
+{
+    XJSON_ASSERT(json);
+
+    xjson_stats stats;
+    memset(&stats, 0, sizeof(stats));
+#if defined(XJSON_STATS)
+    stats = json->stats;
+    // Include what has been written/read of the current document so far
+    if(json->mode == XJSON_STATE_READ)
+        stats.bytes_read += json->current - json->stats_mark;
+    else if(json->mode == XJSON_STATE_WRITE)
+        stats.bytes_written += json->current - json->stats_mark;
+#endif
+    return stats;
+}
+
+void xjson_reset_stats(xjson* json)
+{
+    XJSON_ASSERT(json);
+
+#if defined(XJSON_STATS)
+    memset(&json->stats, 0, sizeof(json->stats));
+    json->stats_mark = json->current;
+#else
+    (void)json;
+#endif
+}
+
+void xjson_object_begin(xjson* json, const char* key)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+
+    if(json->error) return;
+    XJSON_STATS_SCOPE_BEGIN(json);
+
+    if(json->format == XJSON_FORMAT_CBOR)
+    {
+        xjson_cbor_begin(json, key, XJSON_CBOR_MAP);
+        return;
+    }
+
+    if(json->mode == XJSON_STATE_READ){
+        if(!xjson_read_key(json, key))
+        {
+            // Everything inside a missing object is skipped until it ends
+            if(!json->error) json->missing_depth += 1;
+        }
+        else
+        {
+            const uint8_t* bracket = json->current;
+            xjson_expect(json, '{');
+            xjson_push_scope(json, bracket, false);
+        }
+    }
+    else {
+        xjson_print_value_prefix(json, key);
+        xjson_print_token(json, "{", 1);
+        json->needs_comma = false;
+    }
+    json->intendation += 1;
+}
+
+void xjson_object_end(xjson* json)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+    XJSON_ASSERT(json->intendation > 0);
+
+    if(json->error) return;
+
+    if(json->format == XJSON_FORMAT_CBOR)
+    {
+        xjson_cbor_end(json, XJSON_CBOR_MAP);
+        return;
+    }
+
+    json->intendation -= 1;
+
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(json->missing_depth > 0)
+        {
+            json->missing_depth -= 1;
+            return;
+        }
+
+        xjson_scope* scope = &json->scopes[json->intendation];
+        xjson_skip_members(json, scope);
+        json->key_index_top = scope->index_base;
+
+        xjson_expect(json, '}');
+        xjson_try(json, ',');
+    }
+    else 
+    {
+        xjson_print_scope_end(json, "}");
+    }
+    XJSON_STATS_SCOPE_END(json, XJSON_VALUE_OBJECT);
+}
+
+void xjson_array_begin(xjson* json, const char* key)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+
+    if(json->error) return;
+    XJSON_STATS_SCOPE_BEGIN(json);
+
+    if(json->format == XJSON_FORMAT_CBOR)
+    {
+        xjson_cbor_begin(json, key, XJSON_CBOR_ARRAY);
+        return;
+    }
+
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(!xjson_read_key(json, key))
+        {
+            if(!json->error) json->missing_depth += 1;
+        }
+        else
+        {
+            const uint8_t* bracket = json->current;
+            xjson_expect(json, '[');
+            xjson_push_scope(json, bracket, true);
+        }
+    }
+    else 
+    {
+        xjson_print_value_prefix(json, key);
+        xjson_print_token(json, "[", 1);
+        json->needs_comma = false;
+    }
+    json->intendation += 1;
+}
+
+void xjson_array_end(xjson* json)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+    XJSON_ASSERT(json->intendation > 0);
+
+    if(json->error) return;
+
+    if(json->format == XJSON_FORMAT_CBOR)
+    {
+        xjson_cbor_end(json, XJSON_CBOR_ARRAY);
+        return;
+    }
+
+    json->intendation -= 1;
+
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(json->missing_depth > 0)
+        {
+            json->missing_depth -= 1;
+            return;
+        }
+
+        // Skip any elements that haven't been read, the end of the array is known when indexed
+        xjson_scope* scope = &json->scopes[json->intendation];
+        if(scope->end != 0)
+        {
+            json->current = json->start + scope->end;
+        }
+        while(!json->error && json->current < json->end && *json->current != ']')
+        {
+            xjson_skip_current_value(json);
+            xjson_try(json, ',');
+        }
+
+        xjson_expect(json, ']');
+        xjson_try(json, ',');
+    }
+    else 
+    {
+        xjson_print_scope_end(json, "]");
+    }
+    XJSON_STATS_SCOPE_END(json, XJSON_VALUE_ARRAY);
+}
+
+// TODO: Find a better way to handle this. It's not very nice :(
+bool xjson_array_reached_end(xjson* json, int current, int size)
+{
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(json->format == XJSON_FORMAT_CBOR)
+            return json->error || json->missing_depth > 0 || xjson_cbor_reached_scope_end(json);
+
+        if(json->error || json->missing_depth > 0)
+            return true;
+
+        // With the tape, where the array ends is known
+        xjson_scope* scope = json->intendation > 0 ? &json->scopes[json->intendation - 1] : NULL;
+        if(scope != NULL && scope->is_array && scope->end != 0)
+            return json->current >= json->start + scope->end;
+
+        return xjson_peek(json) == ']';
+    }
+    
+    return current >= size;
+}
+
+void xjson_skip_value(xjson* json, const char* key)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+
+    if(json->format == XJSON_FORMAT_CBOR)
+    {
+        xjson_cbor_skip_value(json, key);
+        return;
+    }
+
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(!xjson_read_key(json, key)) return;
+
+        xjson_skip_current_value(json);
+        xjson_try(json, ',');
+    }
+}
+
+void xjson_object_skip_rest(xjson* json)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+    XJSON_ASSERT(json->intendation > 0);
+
+    if(json->mode != XJSON_STATE_READ || json->error || json->missing_depth > 0) return;
+
+    // xjson_object_end skips the rest of a CBOR map
+    if(json->format == XJSON_FORMAT_CBOR) return;
+
+    xjson_skip_members(json, &json->scopes[json->intendation - 1]);
+}
+
+/* Reads/writes a key whose value follows without key. hash is the key's hash or NULL. Returns false if it's missing in the document */
+bool xjson_member_key(xjson* json, const char* key, size_t key_len, const uint32_t* hash)
+{
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(json->format == XJSON_FORMAT_CBOR) return xjson_cbor_read_key_len(json, key, key_len, hash);
+        return xjson_read_key_hashed(json, key, key_len, hash);
+    }
+
+    if(json->format == XJSON_FORMAT_CBOR)
+        xjson_cbor_print_value_prefix_len(json, key, key_len);
+    else
+        xjson_print_value_prefix_len(json, key, key_len);
+
+    // The value follows without a key, just like after xjson_key
+    json->after_key = true;
+    return !json->error;
+}
+
+void xjson_key(xjson* json, const char** key)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+
+    if(json->format == XJSON_FORMAT_CBOR)
+    {
+        xjson_cbor_key(json, key, NULL, true);
+        return;
+    }
+
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(json->error || json->missing_depth > 0) return;
+
+        xjson_expect_and_parse_string(json, key);
+        xjson_expect(json, ':');
+        XJSON_STATS_KEY(json);
+    }
+    else
+    {
+        xjson_print_value_prefix(json, *key);
+        json->after_key = true;
+    }
+}
+
+void xjson_key_view(xjson* json, const char** key, size_t* len)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+    XJSON_ASSERT(key);
+    XJSON_ASSERT(len);
+
+    if(json->format == XJSON_FORMAT_CBOR)
+    {
+        xjson_cbor_key(json, key, len, false);
+        return;
+    }
+
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(json->error || json->missing_depth > 0) return;
+
+        xjson_expect_and_parse_string_view(json, key, len);
+        xjson_expect(json, ':');
+        XJSON_STATS_KEY(json);
+    }
+    else
+    {
+        xjson_print_value_prefix(json, NULL);
+        xjson_print_string(json, *key, *len);
+        xjson_print_token(json, ":", 1);
+        XJSON_STATS_KEY(json);
+        json->after_key = true;
+    }
+}
+
+bool xjson_key_hashed(xjson* json, const char* key, size_t key_len, uint32_t hash)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+    XJSON_ASSERT(key);
+
+    return xjson_member_key(json, key, key_len, &hash);
+}
+
+void xjson_encode_key(xjson_encoded_key* encoded, const char* key, size_t key_len)
+{
+    XJSON_ASSERT(encoded);
+    XJSON_ASSERT(key);
+
+    encoded->key = key;
+    encoded->key_len = key_len;
+    encoded->hash = xjson_hash_key(key, key_len);
+
+    size_t len = 0;
+    bool fits = true;
+    encoded->json[len++] = ',';
+    encoded->json[len++] = '\"';
+    for(size_t i=0; i<key_len && fits; i++)
+    {
+        char buffer[6];
+        size_t escape_len = 1;
+        buffer[0] = key[i];
+        if((uint8_t)key[i] < 0x20 || key[i] == '\"' || key[i] == '\\') escape_len = xjson_escape_char((uint8_t)key[i], buffer);
+
+        // Leaves room for the closing '"' and ':'
+        fits = len + escape_len + 2 <= XJSON_ENCODED_KEY_SIZE;
+        if(fits)
+        {
+            memcpy(encoded->json + len, buffer, escape_len);
+            len += escape_len;
+        }
+    }
+    encoded->json[len++] = '\"';
+    encoded->json[len++] = ':';
+    encoded->json_len = fits ? len : 0;
+
+    // A head with the length in 1 byte or in the byte after it
+    size_t head_len = key_len < 24 ? 1 : 2;
+    if(key_len <= UINT8_MAX && head_len + key_len <= XJSON_ENCODED_KEY_SIZE)
+    {
+        encoded->cbor[0] = (char)((XJSON_CBOR_TEXT << 5) | (key_len < 24 ? key_len : 24));
+        if(head_len == 2) encoded->cbor[1] = (char)key_len;
+        memcpy(encoded->cbor + head_len, key, key_len);
+        encoded->cbor_len = head_len + key_len;
+    }
+    else
+    {
+        encoded->cbor_len = 0;
+    }
+}
+
+bool xjson_key_encoded(xjson* json, const xjson_encoded_key* key)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+    XJSON_ASSERT(key);
+
+    bool cbor = json->format == XJSON_FORMAT_CBOR;
+    if(json->mode == XJSON_STATE_READ || json->error || json->after_key || (cbor ? key->cbor_len : key->json_len) == 0)
+        return xjson_member_key(json, key->key, key->key_len, &key->hash);
+
+    if(cbor)
+    {
+        xjson_print_token(json, key->cbor, key->cbor_len);
+    }
+    else
+    {
+        const char* token = key->json + 1;
+        size_t len = key->json_len - 1;
+        if(json->pretty_print && json->intendation != 0)
+        {
+            if(json->needs_comma) xjson_print_token(json, ",", 1);
+            xjson_print_new_line(json);
+        }
+        else if(json->needs_comma)
+        {
+            // The ',' is encoded in front of the key
+            token--;
+            len++;
+        }
+        xjson_print_token(json, token, len);
+    }
+    XJSON_STATS_KEY(json);
+
+    // The value follows without a key, just like after xjson_key
+    json->after_key = true;
+    return !json->error;
+}
+
+void xjson_integer(xjson* json, const char* key, void* val, xjson_int_type type)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+    XJSON_ASSERT(val);
+
+    if(json->format == XJSON_FORMAT_CBOR)
+    {
+        xjson_cbor_integer(json, key, val, type);
+        return;
+    }
+
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(!xjson_read_key(json, key)) return;
+
+        uint64_t magnitude;
+        bool negative;
+        xjson_expect_and_parse_int(json, &magnitude, &negative);
+        if(json->error) return;
+
+        xjson_store_integer(json, val, type, magnitude, negative);
+        xjson_try(json, ',');
+    }
+    else
+    {
+        xjson_print_value_prefix(json, key);
+
+        bool negative;
+        uint64_t magnitude = xjson_load_integer(val, type, &negative);
+        xjson_print_integer(json, magnitude, negative, xjson_int_max_length[type]);
+
+        json->needs_comma = true;
+    }
+    XJSON_STATS_VALUE(json, XJSON_VALUE_INTEGER, 1);
+}
+
+void xjson_u8(xjson* json, const char* key, uint8_t* val)
+{
+    xjson_integer(json, key, val, XJSON_INT_TYPE_U8);
+}
+
+void xjson_u16(xjson* json, const char* key, uint16_t* val)
+{
+    xjson_integer(json, key, val, XJSON_INT_TYPE_U16);
+}
+
+void xjson_u32(xjson* json, const char* key, uint32_t* val)
+{
+    xjson_integer(json, key, val, XJSON_INT_TYPE_U32);
+}
+
+void xjson_u64(xjson* json, const char* key, uint64_t* val)
+{
+    xjson_integer(json, key, val, XJSON_INT_TYPE_U64);
+}
+
+void xjson_i8(xjson* json, const char* key, int8_t* val)
+{
+    xjson_integer(json, key, val, XJSON_INT_TYPE_I8);
+}
+
+void xjson_i16(xjson* json, const char* key, int16_t* val)
+{
+    xjson_integer(json, key, val, XJSON_INT_TYPE_I16);
+}
+
+void xjson_i32(xjson* json, const char* key, int32_t* val)
+{
+    xjson_integer(json, key, val, XJSON_INT_TYPE_I32);
+}
+
+void xjson_i64(xjson* json, const char* key, int64_t* val)
+{
+    xjson_integer(json, key, val, XJSON_INT_TYPE_I64);
+}
+
+void xjson_float(xjson* json, const char* key, float* val)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+
+    if(json->format == XJSON_FORMAT_CBOR)
+    {
+        xjson_cbor_float(json, key, val);
+        return;
+    }
+
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(!xjson_read_key(json, key)) return;
+
+        xjson_expect_and_parse_float(json, val);
+
+        xjson_try(json, ',');
+    }
+    else
+    {
+        xjson_print_value_prefix(json, key);
+
+        uint32_t bits;
+        memcpy(&bits, val, sizeof(bits));
+        xjson_print_float_bits(json, bits & 0x7FFFFFFF, (bits >> 31) != 0, &xjson_single_format);
+
+        json->needs_comma = true;
+    }
+    XJSON_STATS_VALUE(json, XJSON_VALUE_FLOAT, 1);
+}
+
+void xjson_double(xjson* json, const char* key, double* val)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+
+    if(json->format == XJSON_FORMAT_CBOR)
+    {
+        xjson_cbor_double(json, key, val);
+        return;
+    }
+
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(!xjson_read_key(json, key)) return;
+
+        xjson_expect_and_parse_double(json, val);
+        xjson_try(json, ',');
+    }
+    else
+    {
+        xjson_print_value_prefix(json, key);
+
+        uint64_t bits;
+        memcpy(&bits, val, sizeof(bits));
+        xjson_print_float_bits(json, bits & 0x7FFFFFFFFFFFFFFFull, (bits >> 63) != 0, &xjson_double_format);
+
+        json->needs_comma = true;
+    }
+    XJSON_STATS_VALUE(json, XJSON_VALUE_FLOAT, 1);
+}
+
+/* Formats the number in val at ptr, which must have room for XJSON_FLOAT_MAX_LENGTH characters. Returns the length. */
+int xjson_format_number(char* ptr, const void* val, int type, xjson* json)
+{
+    int len = 0;
+    if(type == XJSON_NUMBER_TYPE_FLOAT || type == XJSON_NUMBER_TYPE_DOUBLE)
+    {
+        const xjson_float_format* format = &xjson_double_format;
+        int sign_bit = 63;
+        uint64_t bits;
+        if(type == XJSON_NUMBER_TYPE_FLOAT)
+        {
+            uint32_t single_bits;
+            memcpy(&single_bits, val, sizeof(single_bits));
+            bits = single_bits;
+            format = &xjson_single_format;
+            sign_bit = 31;
+        }
+        else
+        {
+            memcpy(&bits, val, sizeof(bits));
+        }
+
+        bool negative = (bits >> sign_bit) != 0;
+        bits &= ~((uint64_t)1 << sign_bit);
+        if((int)(bits >> format->mantissa_bits) == format->infinite_power)
+        {
+            xjson_error(json, "NaN and infinity can't be written as json.");
+            return 0;
+        }
+
+        if(negative) ptr[len++] = '-';
+        return len + xjson_format_float(ptr + len, bits, format);
+    }
+
+    bool negative;
+    uint64_t magnitude = xjson_load_integer(val, (xjson_int_type)type, &negative);
+    if(negative) ptr[len++] = '-';
+    return len + xjson_format_u64(ptr + len, magnitude);
+}
+
+/* Reads/writes an array of numbers of the given type in a single loop, without going through the per value calls */
+void xjson_number_array(xjson* json, const char* key, void* vals, size_t capacity, size_t* count, int type)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+    XJSON_ASSERT(vals || capacity == 0);
+
+    XJSON_STATS_SCOPE_BEGIN(json);
+    if(json->format == XJSON_FORMAT_CBOR)
+    {
+        xjson_cbor_number_array(json, key, vals, capacity, count, type);
+        return;
+    }
+
+    size_t size = xjson_number_size[type];
+    uint8_t* val = (uint8_t*)vals;
+
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(!xjson_read_key(json, key)) return;
+        xjson_expect(json, '[');
+
+        size_t read = 0;
+        while(!json->error && xjson_peek(json) != ']')
+        {
+            if(read >= capacity)
+            {
+                xjson_error(json, "Array has more values than fit.");
+                return;
+            }
+
+            if(type == XJSON_NUMBER_TYPE_FLOAT)
+            {
+                xjson_expect_and_parse_float(json, (float*)val);
+            }
+            else if(type == XJSON_NUMBER_TYPE_DOUBLE)
+            {
+                xjson_expect_and_parse_double(json, (double*)val);
+            }
+            else
+            {
+                uint64_t magnitude;
+                bool negative;
+                xjson_expect_and_parse_int(json, &magnitude, &negative);
+                if(json->error) return;
+                xjson_store_integer(json, val, (xjson_int_type)type, magnitude, negative);
+            }
+            val += size;
+            read++;
+
+            // Values are separated by ',', anything else has to be the end of the array
+            if(xjson_peek(json) != ',') break;
+            xjson_consume(json);
+        }
+        if(json->error) return;
+
+        xjson_expect(json, ']');
+        xjson_try(json, ',');
+        if(count != NULL) *count = read;
+        XJSON_STATS_VALUE(json, (type == XJSON_NUMBER_TYPE_FLOAT || type == XJSON_NUMBER_TYPE_DOUBLE) ? XJSON_VALUE_FLOAT : XJSON_VALUE_INTEGER, read);
+    }
+    else
+    {
+        size_t write = count != NULL ? *count : capacity;
+        XJSON_ASSERT(write <= capacity);
+
+        xjson_print_value_prefix(json, key);
+        xjson_print_token(json, "[", 1);
+        json->intendation += 1;
+
+        // Room for the separator, the indentation and the longest number
+        size_t max_length = 2 + (json->pretty_print ? json->intendation : 0) + XJSON_FLOAT_MAX_LENGTH;
+        for(size_t i=0; i<write && !json->error; i++, val += size)
+        {
+            if(!xjson_has_room(json, max_length))
+            {
+                // Close to the end of the buffer, go through the bounds checked path
+                char buffer[XJSON_FLOAT_MAX_LENGTH];
+                json->needs_comma = i > 0;
+                xjson_print_value_prefix(json, NULL);
+                int len = xjson_format_number(buffer, val, type, json);
+                xjson_print_token(json, buffer, len);
+                continue;
+            }
+
+            char* ptr = (char*)json->current;
+            if(i > 0) *ptr++ = ',';
+            if(json->pretty_print)
+            {
+                *ptr++ = '\n';
+                memset(ptr, '\t', json->intendation);
+                ptr += json->intendation;
+            }
+            ptr += xjson_format_number(ptr, val, type, json);
+            json->current = (uint8_t*)ptr;
+        }
+
+        json->intendation -= 1;
+        xjson_print_scope_end(json, "]");
+        XJSON_STATS_VALUE(json, (type == XJSON_NUMBER_TYPE_FLOAT || type == XJSON_NUMBER_TYPE_DOUBLE) ? XJSON_VALUE_FLOAT : XJSON_VALUE_INTEGER, write);
+    }
+    XJSON_STATS_SCOPE_END(json, XJSON_VALUE_ARRAY);
+}
+
+void xjson_u8_array(xjson* json, const char* key, uint8_t* vals, size_t capacity, size_t* count)
+{
+    xjson_number_array(json, key, vals, capacity, count, XJSON_INT_TYPE_U8);
+}
+
+void xjson_u16_array(xjson* json, const char* key, uint16_t* vals, size_t capacity, size_t* count)
+{
+    xjson_number_array(json, key, vals, capacity, count, XJSON_INT_TYPE_U16);
+}
+
+void xjson_u32_array(xjson* json, const char* key, uint32_t* vals, size_t capacity, size_t* count)
+{
+    xjson_number_array(json, key, vals, capacity, count, XJSON_INT_TYPE_U32);
+}
+
+void xjson_u64_array(xjson* json, const char* key, uint64_t* vals, size_t capacity, size_t* count)
+{
+    xjson_number_array(json, key, vals, capacity, count, XJSON_INT_TYPE_U64);
+}
+
+void xjson_i8_array(xjson* json, const char* key, int8_t* vals, size_t capacity, size_t* count)
+{
+    xjson_number_array(json, key, vals, capacity, count, XJSON_INT_TYPE_I8);
+}
+
+void xjson_i16_array(xjson* json, const char* key, int16_t* vals, size_t capacity, size_t* count)
+{
+    xjson_number_array(json, key, vals, capacity, count, XJSON_INT_TYPE_I16);
+}
+
+void xjson_i32_array(xjson* json, const char* key, int32_t* vals, size_t capacity, size_t* count)
+{
+    xjson_number_array(json, key, vals, capacity, count, XJSON_INT_TYPE_I32);
+}
+
+void xjson_i64_array(xjson* json, const char* key, int64_t* vals, size_t capacity, size_t* count)
+{
+    xjson_number_array(json, key, vals, capacity, count, XJSON_INT_TYPE_I64);
+}
+
+void xjson_float_array(xjson* json, const char* key, float* vals, size_t capacity, size_t* count)
+{
+    xjson_number_array(json, key, vals, capacity, count, XJSON_NUMBER_TYPE_FLOAT);
+}
+
+void xjson_double_array(xjson* json, const char* key, double* vals, size_t capacity, size_t* count)
+{
+    xjson_number_array(json, key, vals, capacity, count, XJSON_NUMBER_TYPE_DOUBLE);
+}
+
+size_t xjson_peek_array_size(xjson* json)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+
+    if(json->mode != XJSON_STATE_READ || json->error || json->missing_depth > 0) return 0;
+
+    if(json->format == XJSON_FORMAT_CBOR)
+    {
+        xjson_cbor_head head;
+        const uint8_t* ptr = xjson_cbor_parse_head(json->current, json->end, &head);
+        if(ptr == NULL || head.major != XJSON_CBOR_ARRAY) return 0;
+
+        // Every item takes at least a byte, which keeps a bogus count from being used
+        if(head.info != 31) return head.argument <= (uint64_t)(json->end - ptr) ? (size_t)head.argument : 0;
+
+        size_t size = 0;
+        while(ptr != NULL && ptr < json->end && *ptr != XJSON_CBOR_BREAK)
+        {
+            ptr = xjson_cbor_skip_item(ptr, json->end, 1);
+            size++;
+        }
+        return size;
+    }
+
+    const uint8_t* ptr = xjson_skip_white_space(json->current, json->end);
+    if(ptr >= json->end || *ptr != '[') return 0;
+
+    // Numbers can't contain a ']', so the first one ends the array. Values are separated by ','
+    const uint8_t* end = (const uint8_t*)memchr(ptr, ']', json->end - ptr);
+    if(end == NULL) end = json->end;
+    size_t size = 1;
+    for(; ptr < end; ptr++)
+    {
+        if(*ptr == ',') size++;
+    }
+    return size;
+}
+
+void xjson_bool(xjson* json, const char* key, bool* val)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+
+    if(json->format == XJSON_FORMAT_CBOR)
+    {
+        xjson_cbor_bool(json, key, val);
+        return;
+    }
+
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(!xjson_read_key(json, key)) return;
+
+        xjson_expect_and_parse_bool(json, val);
+        xjson_try(json, ',');
+    }
+    else
+    {
+        xjson_print_value_prefix(json, key);
+
+        if(*val)
+            xjson_print_token(json, "true", 4);
+        else
+            xjson_print_token(json, "false", 5);
+
+        json->needs_comma = true;
+    }
+    XJSON_STATS_VALUE(json, XJSON_VALUE_BOOL, 1);
+}
+
+void xjson_string(xjson* json, const char* key, const char** str)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+
+    if(json->format == XJSON_FORMAT_CBOR)
+    {
+        xjson_cbor_string(json, key, str, NULL, true);
+        return;
+    }
 
-        int len = sprintf((char*)json->current, "%f", *val);
-        json->current += len;
+    if(json->mode == XJSON_STATE_READ)
+    {
+        if(!xjson_read_key(json, key)) return;
 
-        xjson_print_token(json, ",", 1);
+        xjson_expect_and_parse_string(json, str);
+        xjson_try(json, ',');
     }
+    else
+    {
+        xjson_print_value_prefix(json, key);
+        xjson_print_string(json, *str, strlen(*str));
+        json->needs_comma = true;
+    }
+    XJSON_STATS_VALUE(json, XJSON_VALUE_STRING, 1);
 }
 
-void xjson_double(xjson* json, const char* key, double* val)
+void xjson_string_view(xjson* json, const char* key, const char** str, size_t* len)
 {
     XJSON_ASSERT(json);
     XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+    XJSON_ASSERT(str);
+    XJSON_ASSERT(len);
+
+    if(json->format == XJSON_FORMAT_CBOR)
+    {
+        xjson_cbor_string(json, key, str, len, false);
+        return;
+    }
 
     if(json->mode == XJSON_STATE_READ)
     {
-        if(key != NULL)
-        {
-            xjson_expect_key(json, key);
-        }
+        if(!xjson_read_key(json, key)) return;
 
-        xjson_expect_and_parse_double(json, val);
+        xjson_expect_and_parse_string_view(json, str, len);
         xjson_try(json, ',');
     }
     else
     {
-        if(key != NULL)
+        xjson_print_value_prefix(json, key);
+        xjson_print_string(json, *str, *len);
+        json->needs_comma = true;
+    }
+    XJSON_STATS_VALUE(json, XJSON_VALUE_STRING, 1);
+}
+
+/* Size of a single value of each xjson_field_type, structs use the size in their descriptor */
+static const size_t xjson_field_size[] = { 1, 2, 4, 8, 1, 2, 4, 8, sizeof(float), sizeof(double), sizeof(bool), sizeof(const char*) };
+
+/* Reads/writes a single value of a field. The key has been handled already */
+void xjson_field_value(xjson* json, const xjson_field* field, uint8_t* val)
+{
+    switch(field->type)
+    {
+    case XJSON_FIELD_FLOAT:
+        xjson_float(json, NULL, (float*)val);
+        break;
+    case XJSON_FIELD_DOUBLE:
+        xjson_double(json, NULL, (double*)val);
+        break;
+    case XJSON_FIELD_BOOL:
+        xjson_bool(json, NULL, (bool*)val);
+        break;
+    case XJSON_FIELD_STRING:
+        xjson_string(json, NULL, (const char**)val);
+        break;
+    case XJSON_FIELD_NESTED:
+        xjson_struct(json, NULL, val, field->desc);
+        break;
+    default:
+        xjson_integer(json, NULL, val, (xjson_int_type)field->type);
+        break;
+    }
+}
+
+/* Reads/writes the key of a field. Returns false if it's missing in the document */
+bool xjson_field_key(xjson* json, const xjson_field* field)
+{
+    return xjson_member_key(json, field->key, field->key_len, NULL);
+}
+
+void xjson_struct(xjson* json, const char* key, void* obj, const xjson_struct_desc* desc)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+    XJSON_ASSERT(obj);
+    XJSON_ASSERT(desc);
+
+    xjson_object_begin(json, key);
+
+    for(size_t i=0; i<desc->field_count && !json->error && json->missing_depth == 0; i++)
+    {
+        const xjson_field* field = &desc->fields[i];
+        if(!xjson_field_key(json, field)) continue;
+
+        uint8_t* val = (uint8_t*)obj + field->offset;
+        if(field->count == 0)
         {
-            if(json->pretty_print) xjson_print_new_line(json);
-            xjson_print_key(json, key);
+            xjson_field_value(json, field, val);
         }
-        else if(json->pretty_print && xjson_lookback(json) != ':')
+        else if(field->type <= XJSON_FIELD_DOUBLE)
         {
-            xjson_print_new_line(json);
+            xjson_number_array(json, NULL, val, field->count, NULL, field->type);
+        }
+        else
+        {
+            size_t size = field->type == XJSON_FIELD_NESTED ? field->desc->size : xjson_field_size[field->type];
+            xjson_array_begin(json, NULL);
+            for(int j=0; !xjson_array_reached_end(json, j, (int)field->count); j++)
+            {
+                if((size_t)j >= field->count)
+                {
+                    xjson_error(json, "Array has more values than fit.");
+                    break;
+                }
+                xjson_field_value(json, field, val + j * size);
+            }
+            xjson_array_end(json);
         }
+    }
+
+    xjson_object_end(json);
+}
+
+//----------------------------------------------------------------------------------
+// Threads
+//
+// Thin wrappers around pthreads/Win32 threads for the functions that spread work across cores. Threads are only 
+// used if XJSON_THREADS is defined, otherwise the wrappers do nothing and all work runs on the calling thread.
+//----------------------------------------------------------------------------------
+
+#if defined(XJSON_THREADS) && defined(_WIN32)
+typedef CRITICAL_SECTION xjson_mutex;
+typedef CONDITION_VARIABLE xjson_cond;
+typedef HANDLE xjson_thread;
+#elif defined(XJSON_THREADS)
+typedef pthread_mutex_t xjson_mutex;
+typedef pthread_cond_t xjson_cond;
+typedef pthread_t xjson_thread;
+#else
+// Without threads everything runs on the calling thread and there is nothing to synchronize
+typedef int xjson_mutex;
+typedef int xjson_cond;
+typedef int xjson_thread;
+#endif
+
+void xjson_mutex_init(xjson_mutex* mutex, xjson_cond* cond)
+{
+#if defined(XJSON_THREADS) && defined(_WIN32)
+    InitializeCriticalSection(mutex);
+    InitializeConditionVariable(cond);
+#elif defined(XJSON_THREADS)
+    pthread_mutex_init(mutex, NULL);
+    pthread_cond_init(cond, NULL);
+#else
+    (void)mutex; (void)cond;
+#endif
+}
+
+void xjson_mutex_destroy(xjson_mutex* mutex, xjson_cond* cond)
+{
+#if defined(XJSON_THREADS) && defined(_WIN32)
+    DeleteCriticalSection(mutex);
+    (void)cond;
+#elif defined(XJSON_THREADS)
+    pthread_mutex_destroy(mutex);
+    pthread_cond_destroy(cond);
+#else
+    (void)mutex; (void)cond;
+#endif
+}
+
+void xjson_mutex_lock(xjson_mutex* mutex)
+{
+#if defined(XJSON_THREADS) && defined(_WIN32)
+    EnterCriticalSection(mutex);
+#elif defined(XJSON_THREADS)
+    pthread_mutex_lock(mutex);
+#else
+    (void)mutex;
+#endif
+}
+
+void xjson_mutex_unlock(xjson_mutex* mutex)
+{
+#if defined(XJSON_THREADS) && defined(_WIN32)
+    LeaveCriticalSection(mutex);
+#elif defined(XJSON_THREADS)
+    pthread_mutex_unlock(mutex);
+#else
+    (void)mutex;
+#endif
+}
 
-        int len = sprintf((char*)json->current, "%f", *val);
-        json->current += len;
+void xjson_cond_wait(xjson_cond* cond, xjson_mutex* mutex)
+{
+#if defined(XJSON_THREADS) && defined(_WIN32)
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+#elif defined(XJSON_THREADS)
+    pthread_cond_wait(cond, mutex);
+#else
+    // Batches complete in order on a single thread, so a batch is always delivered before anyone would wait for it
+    (void)cond; (void)mutex;
+    XJSON_ASSERT(false);
+#endif
+}
+
+void xjson_cond_broadcast(xjson_cond* cond)
+{
+#if defined(XJSON_THREADS) && defined(_WIN32)
+    WakeAllConditionVariable(cond);
+#elif defined(XJSON_THREADS)
+    pthread_cond_broadcast(cond);
+#else
+    (void)cond;
+#endif
+}
+
+/* Returns how many threads to use when requested were asked for, 0 or less means one per core. Always 1 if threads 
+   aren't enabled */
+int xjson_thread_count(int requested)
+{
+#if defined(XJSON_THREADS) && defined(_WIN32)
+    if(requested > 0) return requested;
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#elif defined(XJSON_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+    if(requested > 0) return requested;
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#elif defined(XJSON_THREADS)
+    return requested > 0 ? requested : 1;
+#else
+    (void)requested;
+    return 1;
+#endif
+}
+
+typedef struct xjson_worker
+{
+    xjson_thread thread;
+    void (*work)(void* context, int index);
+    void* context;
+    int index;
+} xjson_worker;
+
+#if defined(XJSON_THREADS) && defined(_WIN32)
+DWORD WINAPI xjson_worker_thread(LPVOID param)
+{
+    xjson_worker* worker = (xjson_worker*)param;
+    worker->work(worker->context, worker->index);
+    return 0;
+}
+#elif defined(XJSON_THREADS)
+void* xjson_worker_thread(void* param)
+{
+    xjson_worker* worker = (xjson_worker*)param;
+    worker->work(worker->context, worker->index);
+    return NULL;
+}
+#endif
+
+/* Calls work with indices 0 to worker_count - 1 on as many threads and waits for all of them. Index 0 runs on the 
+   calling thread. The work has to be shared dynamically, as threads that fail to start never run their index. */
+void xjson_run_workers(void (*work)(void* context, int index), void* context, int worker_count)
+{
+#if defined(XJSON_THREADS)
+    xjson_worker* workers = (xjson_worker*)XJSON_MALLOC(sizeof(xjson_worker) * worker_count);
+    XJSON_ASSERT(workers);
+
+    int started = 1;
+    for(; started < worker_count; started++)
+    {
+        xjson_worker* worker = &workers[started];
+        worker->work = work;
+        worker->context = context;
+        worker->index = started;
+#if defined(_WIN32)
+        worker->thread = CreateThread(NULL, 0, xjson_worker_thread, worker, 0, NULL);
+        if(worker->thread == NULL) break;
+#else
+        if(pthread_create(&worker->thread, NULL, xjson_worker_thread, worker) != 0) break;
+#endif
+    }
 
-        xjson_print_token(json, ",", 1);
+    work(context, 0);
+    for(int i=1; i<started; i++)
+    {
+#if defined(_WIN32)
+        WaitForSingleObject(workers[i].thread, INFINITE);
+        CloseHandle(workers[i].thread);
+#else
+        pthread_join(workers[i].thread, NULL);
+#endif
     }
+    XJSON_FREE(workers);
+#else
+    (void)worker_count;
+    work(context, 0);
+#endif
 }
 
-void xjson_bool(xjson* json, const char* key, bool* val)
+//----------------------------------------------------------------------------------
+// JSON Lines
+//
+// The input is cut into batches of about XJSON_NDJSON_BATCH_SIZE bytes that end at a line break. Worker threads first 
+// count the lines of each batch so every line knows its number, then take batches one at a time and read their lines. 
+// The counting pass is one memchr per line over the whole input, split over the threads. At several GB/s it adds a 
+// few percent to reading, which is what giving the callback the line number costs.
+// For ordered delivery, the thread that completes the oldest outstanding batch delivers it and any finished batches 
+// after it, without holding the mutex. Unordered delivery works the same way, but batches are queued as they finish. 
+// A thread waits until its batch has been delivered before it reuses its arena.
+//----------------------------------------------------------------------------------
+
+/* A line that was read and the callback's result, kept until it's delivered */
+typedef struct xjson_ndjson_result
 {
-    XJSON_ASSERT(json);
-    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+    size_t line;
+    void* result;
+} xjson_ndjson_result;
 
-    if(json->mode == XJSON_STATE_READ)
+typedef struct xjson_ndjson_batch
+{
+    const char* begin;
+    const char* end;
+    // Number of the first line and how many lines there are, including one without a line break at the very end
+    size_t first_line;
+    size_t line_count;
+    // Delivery only
+    xjson_ndjson_result* results;
+    size_t result_count;
+    bool done;
+    bool delivered;
+} xjson_ndjson_batch;
+
+typedef struct xjson_ndjson_worker xjson_ndjson_worker;
+
+typedef struct xjson_ndjson_job
+{
+    xjson_ndjson_batch* batches;
+    size_t batch_count;
+    xjson_ndjson_callback callback;
+    xjson_ndjson_deliver deliver;
+    bool ordered;
+    void* user;
+
+    // Guarded by mutex. The next batch to be counted/read and the next one to be delivered
+    xjson_mutex mutex;
+    xjson_cond delivered;
+    size_t next_batch;
+    size_t next_delivery;
+    // Unordered delivery only. Indices of the finished batches in the order they finished, next_delivery indexes this
+    size_t* completed;
+    size_t completed_count;
+    // A thread is calling deliver
+    bool delivering;
+    bool counting;
+    size_t lines_read;
+
+    xjson_ndjson_worker* workers;
+} xjson_ndjson_job;
+
+struct xjson_ndjson_worker
+{
+    xjson_ndjson_job* job;
+    xjson_arena arena;
+    xjson json;
+};
+
+/* Takes the next batch, returns false if all have been taken */
+bool xjson_ndjson_next_batch(xjson_ndjson_job* job, size_t* index)
+{
+    xjson_mutex_lock(&job->mutex);
+    *index = job->next_batch;
+    if(job->next_batch < job->batch_count) job->next_batch++;
+    xjson_mutex_unlock(&job->mutex);
+    return *index < job->batch_count;
+}
+
+/* Hands all finished batches that are next in line to deliver, in line order or in the order they finished. mutex must 
+   be held, it's released while deliver is called so the other threads can go on taking batches. Only one thread delivers 
+   at a time, batches that are finished in the meantime are delivered by it as well. */
+void xjson_ndjson_deliver_ready(xjson_ndjson_job* job)
+{
+    if(job->delivering) return;
+
+    job->delivering = true;
+    for(;;)
     {
-        if(key != NULL)
+        size_t first = job->next_delivery;
+        size_t last = first;
+        if(job->ordered)
+        {
+            while(last < job->batch_count && job->batches[last].done) last++;
+        }
+        else
         {
-            xjson_expect_key(json, key);
+            last = job->completed_count;
         }
+        if(last == first) break;
 
-        xjson_expect_and_parse_bool(json, val);
-        xjson_try(json, ',');
+        xjson_mutex_unlock(&job->mutex);
+        for(size_t index = first; index < last; index++)
+        {
+            xjson_ndjson_batch* batch = &job->batches[job->ordered ? index : job->completed[index]];
+            for(size_t i=0; i<batch->result_count; i++)
+            {
+                job->deliver(batch->results[i].result, batch->results[i].line, job->user);
+            }
+            XJSON_FREE(batch->results);
+            batch->results = NULL;
+        }
+        xjson_mutex_lock(&job->mutex);
+
+        for(size_t index = first; index < last; index++)
+        {
+            job->batches[job->ordered ? index : job->completed[index]].delivered = true;
+        }
+        job->next_delivery = last;
+        xjson_cond_broadcast(&job->delivered);
     }
-    else
+    job->delivering = false;
+}
+
+void xjson_ndjson_read_batch(xjson_ndjson_worker* worker, size_t index)
+{
+    xjson_ndjson_job* job = worker->job;
+    xjson_ndjson_batch* batch = &job->batches[index];
+    xjson* json = &worker->json;
+
+    if(job->deliver != NULL)
+    {
+        batch->results = (xjson_ndjson_result*)XJSON_MALLOC(sizeof(xjson_ndjson_result) * (batch->line_count + 1));
+        XJSON_ASSERT(batch->results);
+    }
+
+    size_t lines_read = 0;
+    size_t line = batch->first_line;
+    for(const char* ptr = batch->begin; ptr < batch->end; line++)
     {
-        if(key != NULL)
+        const char* line_end = (const char*)memchr(ptr, '\n', batch->end - ptr);
+        if(line_end == NULL) line_end = batch->end;
+        const char* next = line_end + (line_end < batch->end ? 1 : 0);
+
+        // Lines may end in \r\n and may be indented, blank lines are skipped
+        const uint8_t* begin = xjson_skip_white_space((uint8_t*)ptr, (uint8_t*)line_end);
+        while(line_end > (const char*)begin && xjson_is_white_space(line_end[-1])) line_end--;
+        ptr = next;
+        if((const char*)begin == line_end) continue;
+
+        xjson_set_arena(json, &worker->arena);
+        xjson_setup_read(json, (const char*)begin, line_end - (const char*)begin);
+        json->error = false;
+        void* result = job->callback(json, line, job->user);
+        lines_read++;
+
+        if(job->deliver != NULL)
         {
-            if(json->pretty_print) xjson_print_new_line(json);
-            xjson_print_key(json, key);
+            batch->results[batch->result_count].line = line;
+            batch->results[batch->result_count].result = result;
+            batch->result_count++;
         }
-        else if(json->pretty_print && xjson_lookback(json) != ':')
+        else
         {
-            xjson_print_new_line(json);
+            xjson_arena_reset(&worker->arena);
+        }
+    }
+
+    xjson_mutex_lock(&job->mutex);
+    job->lines_read += lines_read;
+    if(job->deliver != NULL)
+    {
+        batch->done = true;
+        if(!job->ordered) job->completed[job->completed_count++] = index;
+        xjson_ndjson_deliver_ready(job);
+        // The strings of this batch live in the arena until they have been delivered
+        while(!batch->delivered)
+        {
+            xjson_cond_wait(&job->delivered, &job->mutex);
         }
+    }
+    xjson_mutex_unlock(&job->mutex);
 
-        int len = sprintf((char*)json->current, "%s", *val == true ? "true" : "false");
-        json->current += len;
+    xjson_arena_reset(&worker->arena);
+}
 
-        xjson_print_token(json, ",", 1);
+void xjson_ndjson_work(void* context, int worker_index)
+{
+    xjson_ndjson_job* job = (xjson_ndjson_job*)context;
+    xjson_ndjson_worker* worker = &job->workers[worker_index];
+    size_t index;
+    while(xjson_ndjson_next_batch(job, &index))
+    {
+        if(job->counting)
+        {
+            xjson_ndjson_batch* batch = &job->batches[index];
+            size_t count = 0;
+            for(const char* ptr = batch->begin; (ptr = (const char*)memchr(ptr, '\n', batch->end - ptr)) != NULL; ptr++)
+            {
+                count++;
+            }
+            batch->line_count = count + (batch->end[-1] != '\n' ? 1 : 0);
+        }
+        else
+        {
+            xjson_ndjson_read_batch(worker, index);
+        }
     }
 }
 
-void xjson_string(xjson* json, const char* key, const char** str)
+size_t xjson_ndjson_for_each(const char* buffer, size_t len, int thread_count, xjson_ndjson_callback callback, 
+    xjson_ndjson_deliver deliver, bool ordered, void* user)
+{
+    XJSON_ASSERT(buffer || len == 0);
+    XJSON_ASSERT(callback);
+
+    if(len == 0) return 0;
+
+    thread_count = xjson_thread_count(thread_count);
+
+    xjson_ndjson_job job;
+    memset(&job, 0, sizeof(job));
+    job.callback = callback;
+    job.deliver = deliver;
+    job.ordered = ordered;
+    job.user = user;
+
+    // Cut the input into batches that end right after a line break
+    size_t batch_capacity = len / XJSON_NDJSON_BATCH_SIZE + 1;
+    job.batches = (xjson_ndjson_batch*)XJSON_MALLOC(sizeof(xjson_ndjson_batch) * batch_capacity);
+    XJSON_ASSERT(job.batches);
+    const char* end = buffer + len;
+    for(const char* ptr = buffer; ptr < end; job.batch_count++)
+    {
+        const char* batch_end = (size_t)(end - ptr) > XJSON_NDJSON_BATCH_SIZE ? ptr + XJSON_NDJSON_BATCH_SIZE : end;
+        const char* line_end = (const char*)memchr(batch_end - 1, '\n', end - (batch_end - 1));
+        batch_end = line_end != NULL ? line_end + 1 : end;
+
+        XJSON_ASSERT(job.batch_count < batch_capacity);
+        memset(&job.batches[job.batch_count], 0, sizeof(xjson_ndjson_batch));
+        job.batches[job.batch_count].begin = ptr;
+        job.batches[job.batch_count].end = batch_end;
+        ptr = batch_end;
+    }
+    if((size_t)thread_count > job.batch_count) thread_count = (int)job.batch_count;
+    if(deliver != NULL && !ordered)
+    {
+        job.completed = (size_t*)XJSON_MALLOC(sizeof(size_t) * job.batch_count);
+        XJSON_ASSERT(job.completed);
+    }
+
+    xjson_ndjson_worker* workers = (xjson_ndjson_worker*)XJSON_MALLOC(sizeof(xjson_ndjson_worker) * thread_count);
+    XJSON_ASSERT(workers);
+    job.workers = workers;
+    for(int i=0; i<thread_count; i++)
+    {
+        memset(&workers[i].json, 0, sizeof(xjson));
+        workers[i].job = &job;
+        xjson_arena_init(&workers[i].arena, XJSON_NDJSON_ARENA_SIZE);
+    }
+    xjson_mutex_init(&job.mutex, &job.delivered);
+
+    // Count the lines of every batch first, so each line knows its number
+    job.counting = true;
+    xjson_run_workers(xjson_ndjson_work, &job, thread_count);
+    size_t line = 0;
+    for(size_t i=0; i<job.batch_count; i++)
+    {
+        job.batches[i].first_line = line;
+        line += job.batches[i].line_count;
+    }
+
+    job.counting = false;
+    job.next_batch = 0;
+    xjson_run_workers(xjson_ndjson_work, &job, thread_count);
+
+    xjson_mutex_destroy(&job.mutex, &job.delivered);
+    for(int i=0; i<thread_count; i++)
+    {
+        xjson_arena_free(&workers[i].arena);
+        xjson_free(&workers[i].json);
+    }
+    XJSON_FREE(workers);
+    XJSON_FREE(job.completed);
+    XJSON_FREE(job.batches);
+    return job.lines_read;
+}
+
+//----------------------------------------------------------------------------------
+// Parallel arrays
+//
+// The elements are cut into a few slices per thread, which the threads take one at a time. Every slice is written 
+// into a fragment of its own through a sink, starting out in the state the parent xjson would be in at that element 
+// (indentation, and whether a ',' is needed). Joining the fragments in order then gives the same output as a loop.
+//----------------------------------------------------------------------------------
+
+#ifndef XJSON_SLICES_PER_THREAD
+#define XJSON_SLICES_PER_THREAD 4
+#endif
+
+/* The output of a slice of the array */
+typedef struct xjson_fragment
+{
+    uint8_t* data;
+    size_t len;
+    size_t capacity;
+    bool error;
+    char error_message[256];
+} xjson_fragment;
+
+typedef struct xjson_array_job
+{
+    xjson* parent;
+    xjson_element_callback element;
+    void* user;
+    size_t element_count;
+    size_t slice_count;
+    xjson_fragment* fragments;
+    // One writer per worker thread
+    xjson* writers;
+
+    // Guarded by mutex
+    xjson_mutex mutex;
+    xjson_cond cond;
+    size_t next_slice;
+} xjson_array_job;
+
+/* Sink of the slice writers, appends to the fragment */
+bool xjson_fragment_append(const char* data, size_t len, void* user)
+{
+    xjson_fragment* fragment = (xjson_fragment*)user;
+    if(fragment->len + len > fragment->capacity)
+    {
+        size_t capacity = fragment->capacity * 2 > fragment->len + len ? fragment->capacity * 2 : fragment->len + len;
+        uint8_t* data_new = (uint8_t*)XJSON_MALLOC(capacity);
+        if(data_new == NULL) return false;
+        if(fragment->len > 0) memcpy(data_new, fragment->data, fragment->len);
+        XJSON_FREE(fragment->data);
+        fragment->data = data_new;
+        fragment->capacity = capacity;
+    }
+    memcpy(fragment->data + fragment->len, data, len);
+    fragment->len += len;
+    return true;
+}
+
+void xjson_array_work(void* context, int worker_index)
+{
+    xjson_array_job* job = (xjson_array_job*)context;
+    xjson* parent = job->parent;
+    xjson* writer = &job->writers[worker_index];
+
+    for(;;)
+    {
+        xjson_mutex_lock(&job->mutex);
+        size_t slice = job->next_slice;
+        if(slice < job->slice_count) job->next_slice++;
+        xjson_mutex_unlock(&job->mutex);
+        if(slice >= job->slice_count) break;
+
+        size_t begin = job->element_count * slice / job->slice_count;
+        size_t end = job->element_count * (slice + 1) / job->slice_count;
+        xjson_fragment* fragment = &job->fragments[slice];
+
+        xjson_setup_write_sink(writer, parent->pretty_print, xjson_fragment_append, fragment);
+        writer->format = parent->format;
+        writer->intendation = parent->intendation;
+        writer->needs_comma = begin > 0;
+        writer->error = false;
+        for(size_t i=begin; i<end && !writer->error; i++)
+        {
+            job->element(writer, i, job->user);
+        }
+        xjson_flush(writer);
+
+        fragment->error = writer->error;
+        if(writer->error) strcpy(fragment->error_message, writer->error_message);
+    }
+}
+
+void xjson_parallel_array(xjson* json, const char* key, size_t capacity, size_t* count, int thread_count, 
+    xjson_element_callback element, void* user)
 {
     XJSON_ASSERT(json);
     XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+    XJSON_ASSERT(element);
+
+    if(json->error) return;
+
+    xjson_array_begin(json, key);
 
     if(json->mode == XJSON_STATE_READ)
     {
-        if(key != NULL)
+        bool present = !json->error && json->missing_depth == 0;
+        size_t read = 0;
+        for(; !xjson_array_reached_end(json, (int)read, 0); read++)
         {
-            xjson_expect_key(json, key);
+            if(read >= capacity)
+            {
+                xjson_error(json, "Array has more values than fit.");
+                break;
+            }
+            element(json, read, user);
         }
+        xjson_array_end(json);
+        if(present && !json->error && count != NULL) *count = read;
+        return;
+    }
 
-        xjson_expect_and_parse_string(json, str);
-        xjson_try(json, ',');
+    size_t write = count != NULL ? *count : capacity;
+    XJSON_ASSERT(write <= capacity);
+
+    thread_count = xjson_thread_count(thread_count);
+    if(thread_count == 1 || write < 2 || json->mode == XJSON_STATE_MEASURE)
+    {
+        // Nothing to split up (measuring is cheap enough on one thread), write straight into the output
+        for(size_t i=0; i<write && !json->error; i++)
+        {
+            element(json, i, user);
+        }
+        xjson_array_end(json);
+        return;
     }
-    else
+
+    xjson_array_job job;
+    memset(&job, 0, sizeof(job));
+    job.parent = json;
+    job.element = element;
+    job.user = user;
+    job.element_count = write;
+    job.slice_count = (size_t)thread_count * XJSON_SLICES_PER_THREAD < write ? (size_t)thread_count * XJSON_SLICES_PER_THREAD : write;
+    if((size_t)thread_count > job.slice_count) thread_count = (int)job.slice_count;
+
+    job.fragments = (xjson_fragment*)XJSON_MALLOC(sizeof(xjson_fragment) * job.slice_count);
+    job.writers = (xjson*)XJSON_MALLOC(sizeof(xjson) * thread_count);
+    XJSON_ASSERT(job.fragments && job.writers);
+    memset(job.fragments, 0, sizeof(xjson_fragment) * job.slice_count);
+    for(int i=0; i<thread_count; i++)
     {
-        if(key != NULL)
+        memset(&job.writers[i], 0, sizeof(xjson));
+    }
+
+    xjson_mutex_init(&job.mutex, &job.cond);
+    xjson_run_workers(xjson_array_work, &job, thread_count);
+    xjson_mutex_destroy(&job.mutex, &job.cond);
+#if defined(XJSON_STATS)
+    for(int i=0; i<thread_count; i++)
+    {
+        xjson_stats_merge(json, &job.writers[i].stats);
+    }
+#endif
+
+    for(size_t i=0; i<job.slice_count; i++)
+    {
+        xjson_fragment* fragment = &job.fragments[i];
+        if(!json->error && fragment->error)
         {
-            if(json->pretty_print) xjson_print_new_line(json);
-            xjson_print_key(json, key);
+            json->error = true;
+            strcpy(json->error_message, fragment->error_message);
         }
-        else if(json->pretty_print && xjson_lookback(json) != ':')
+        else if(!json->error && json->flush != NULL)
         {
-            xjson_print_new_line(json);
+            // Fragments go to the sink as they are, without copying them into the chunk first
+            xjson_flush(json);
+            if(!json->error && !json->flush((const char*)fragment->data, fragment->len, json->flush_user))
+                xjson_error(json, "Failed to flush the output.");
+            XJSON_STATS_ADD(json, bytes_written, fragment->len);
+            xjson_cache_capture_direct(json, fragment->data, fragment->len);
+        }
+        else
+        {
+            xjson_print_token(json, (const char*)fragment->data, fragment->len);
+        }
+        XJSON_FREE(fragment->data);
+    }
+    XJSON_FREE(job.fragments);
+    XJSON_FREE(job.writers);
+
+    json->needs_comma = true;
+    xjson_array_end(json);
+}
+
+//----------------------------------------------------------------------------------
+// Fragment cache
+// Objects that haven't changed since they were last written are copied from a cache
+// instead of being written member by member again.
+//----------------------------------------------------------------------------------
+
+bool xjson_cache_init(xjson_cache* cache, size_t entry_count)
+{
+    XJSON_ASSERT(cache);
+    XJSON_ASSERT(entry_count > 0);
+
+    size_t count = 1;
+    while(count < entry_count) count <<= 1;
+
+    memset(cache, 0, sizeof(xjson_cache));
+    cache->entries = (xjson_cache_entry*)XJSON_MALLOC(sizeof(xjson_cache_entry) * count);
+    if(cache->entries == NULL) return false;
+    memset(cache->entries, 0, sizeof(xjson_cache_entry) * count);
+    cache->mask = count - 1;
+    return true;
+}
+
+void xjson_cache_free(xjson_cache* cache)
+{
+    XJSON_ASSERT(cache);
+
+    if(cache->entries != NULL)
+    {
+        for(size_t i=0; i<=cache->mask; i++)
+        {
+            XJSON_FREE(cache->entries[i].data);
         }
+        XJSON_FREE(cache->entries);
+    }
+    memset(cache, 0, sizeof(xjson_cache));
+}
+
+void xjson_set_cache(xjson* json, xjson_cache* cache)
+{
+    XJSON_ASSERT(json);
+
+    xjson_cache_abort(json);
+    json->cache = cache;
+}
+
+/* Writes a recorded object. If it was recorded at another depth, the tabs after each new line are adjusted */
+void xjson_cache_splice(xjson* json, const xjson_cache_entry* entry)
+{
+    if(!json->pretty_print || json->format != XJSON_FORMAT_JSON || entry->depth == json->intendation)
+    {
+        xjson_print_token(json, (const char*)entry->data, entry->len);
+        return;
+    }
+
+    // All new lines are written by xjson_print_new_line, so they are followed by at least depth tabs
+    const uint8_t* ptr = entry->data;
+    const uint8_t* end = entry->data + entry->len;
+    while(ptr < end && !json->error)
+    {
+        const uint8_t* line_end = (const uint8_t*)memchr(ptr, '\n', end - ptr);
+        if(line_end == NULL) line_end = end;
+        xjson_print_token(json, (const char*)ptr, line_end - ptr);
+        if(line_end == end) break;
+
+        xjson_print_new_line(json);
+        ptr = line_end + 1 + entry->depth;
+    }
+}
+
+bool xjson_object_begin_cached(xjson* json, const char* key, uint64_t id, uint64_t version)
+{
+    XJSON_ASSERT(json);
+    XJSON_ASSERT(json->mode != XJSON_STATE_UNITIALIZED);
+
+    if(json->error) return false;
+
+    if(json->mode == XJSON_STATE_READ || json->cache == NULL)
+    {
+        xjson_object_begin(json, key);
+        return !json->error;
+    }
+
+    xjson_cache* cache = json->cache;
+    xjson_cache_entry* entry = &cache->entries[(size_t)((id * 0x9E3779B97F4A7C15ull) >> 32) & cache->mask];
+    if(entry->valid && entry->id == id && entry->version == version && 
+       entry->pretty_print == json->pretty_print && entry->format == json->format)
+    {
+        cache->hits++;
+        XJSON_STATS_SCOPE_BEGIN(json);
+
+        if(json->format == XJSON_FORMAT_CBOR)
+            xjson_cbor_print_value_prefix(json, key);
+        else
+            xjson_print_value_prefix(json, key);
+        xjson_cache_splice(json, entry);
+        json->needs_comma = true;
+
+        if(json->intendation == 0) xjson_print_document_end(json);
+        XJSON_STATS_SCOPE_END(json, XJSON_VALUE_OBJECT);
+        return false;
+    }
 
-        int len = sprintf((char*)json->current, "\"%s\"", *str);
-        json->current += len;
-        
-        xjson_print_token(json, ",", 1);
+    cache->misses++;
+    xjson_object_begin(json, key);
+    if(json->error) return false;
+
+    // Nothing to record when measuring, or if the entry is being recorded by an enclosing object already
+    if(json->mode == XJSON_STATE_WRITE && !entry->recording)
+    {
+        entry->id = id;
+        entry->version = version;
+        entry->valid = false;
+        entry->pretty_print = json->pretty_print;
+        entry->format = json->format;
+        entry->depth = json->intendation - 1;
+        entry->len = 0;
+        entry->recording = true;
+        entry->failed = false;
+        // The object's opening byte was just written
+        entry->record_from = json->current - 1;
+        entry->outer = json->cache_recording;
+        json->cache_recording = entry;
     }
+    return true;
 }
 #endif // XJSON_H_IMPLEMENTATION
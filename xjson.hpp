@@ -0,0 +1,291 @@
+/*
+    C++ bindings for xjson.h. Keys are string literals whose length and hash are
+    worked out at compile time, and std::string, std::string_view, std::vector,
+    std::array and std::optional are read/written with the same symmetric calls.
+
+    Requires C++17. xjson.h is included by this header, define XJSON_H_IMPLEMENTATION
+    in one source file before including either of them.
+
+    LICENSE
+    =======
+    zlib/libpng license, see xjson.h
+*/
+#ifndef XJSON_HPP
+#define XJSON_HPP
+
+#include "xjson.h"
+
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Keys are guaranteed to be hashed at compile time where consteval is available
+#if defined(__cpp_consteval)
+#define XJSON_CONSTEVAL consteval
+#else
+#define XJSON_CONSTEVAL constexpr
+#endif
+
+namespace xj
+{
+
+/* Same as xjson_hash_key */
+constexpr uint32_t hash_key(const char* key, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for(size_t i=0; i<len; i++)
+    {
+        hash ^= (uint8_t)key[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* A key with its length and hash. String literals convert to it implicitly */
+struct key
+{
+    const char* str;
+    size_t len;
+    uint32_t hash;
+
+    template<size_t N>
+    XJSON_CONSTEVAL key(const char (&literal)[N]) : str(literal), len(N - 1), hash(hash_key(literal, N - 1)) {}
+    // For keys that are only known at runtime
+    constexpr key(const char* key_str, size_t key_len) : str(key_str), len(key_len), hash(hash_key(key_str, key_len)) {}
+};
+
+/* Numbers that have an xjson_*_array function */
+template<class T>
+inline constexpr bool is_number = std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t> || std::is_same_v<T, uint32_t> ||
+    std::is_same_v<T, uint64_t> || std::is_same_v<T, int8_t> || std::is_same_v<T, int16_t> || std::is_same_v<T, int32_t> ||
+    std::is_same_v<T, int64_t> || std::is_same_v<T, float> || std::is_same_v<T, double>;
+
+inline bool is_reading(xjson* json)
+{
+    return xjson_get_state(json) == XJSON_STATE_READ;
+}
+
+//----------------------------------------------------------------------------------
+// Values without key, e.g. array elements. Types of your own are bound by a function
+// value(xjson*, T&) next to the type, which is found by argument-dependent lookup.
+//----------------------------------------------------------------------------------
+
+inline void value(xjson* json, uint8_t& val) { xjson_u8(json, nullptr, &val); }
+inline void value(xjson* json, uint16_t& val) { xjson_u16(json, nullptr, &val); }
+inline void value(xjson* json, uint32_t& val) { xjson_u32(json, nullptr, &val); }
+inline void value(xjson* json, uint64_t& val) { xjson_u64(json, nullptr, &val); }
+inline void value(xjson* json, int8_t& val) { xjson_i8(json, nullptr, &val); }
+inline void value(xjson* json, int16_t& val) { xjson_i16(json, nullptr, &val); }
+inline void value(xjson* json, int32_t& val) { xjson_i32(json, nullptr, &val); }
+inline void value(xjson* json, int64_t& val) { xjson_i64(json, nullptr, &val); }
+inline void value(xjson* json, float& val) { xjson_float(json, nullptr, &val); }
+inline void value(xjson* json, double& val) { xjson_double(json, nullptr, &val); }
+inline void value(xjson* json, bool& val) { xjson_bool(json, nullptr, &val); }
+
+inline void number_array(xjson* json, uint8_t* vals, size_t capacity, size_t* count) { xjson_u8_array(json, nullptr, vals, capacity, count); }
+inline void number_array(xjson* json, uint16_t* vals, size_t capacity, size_t* count) { xjson_u16_array(json, nullptr, vals, capacity, count); }
+inline void number_array(xjson* json, uint32_t* vals, size_t capacity, size_t* count) { xjson_u32_array(json, nullptr, vals, capacity, count); }
+inline void number_array(xjson* json, uint64_t* vals, size_t capacity, size_t* count) { xjson_u64_array(json, nullptr, vals, capacity, count); }
+inline void number_array(xjson* json, int8_t* vals, size_t capacity, size_t* count) { xjson_i8_array(json, nullptr, vals, capacity, count); }
+inline void number_array(xjson* json, int16_t* vals, size_t capacity, size_t* count) { xjson_i16_array(json, nullptr, vals, capacity, count); }
+inline void number_array(xjson* json, int32_t* vals, size_t capacity, size_t* count) { xjson_i32_array(json, nullptr, vals, capacity, count); }
+inline void number_array(xjson* json, int64_t* vals, size_t capacity, size_t* count) { xjson_i64_array(json, nullptr, vals, capacity, count); }
+inline void number_array(xjson* json, float* vals, size_t capacity, size_t* count) { xjson_float_array(json, nullptr, vals, capacity, count); }
+inline void number_array(xjson* json, double* vals, size_t capacity, size_t* count) { xjson_double_array(json, nullptr, vals, capacity, count); }
+
+/* The string allocator for std::string_view in place of xjson_malloc_string, mem_ctx is a bool that is set */
+inline char* reject_escaped(const char*, size_t, void* mem_ctx)
+{
+    *static_cast<bool*>(mem_ctx) = true;
+    return nullptr;
+}
+
+/* When reading, the view points into the json input. Strings with escape sequences are decoded by the string allocator, 
+   which has to be an arena or another one whose memory doesn't need to be freed one string at a time. With the default 
+   xjson_malloc_string they are an error, as the view can't free the string. */
+inline void value(xjson* json, std::string_view& val)
+{
+    const char* str = val.data() != nullptr ? val.data() : "";
+    size_t len = val.size();
+    if(!is_reading(json) || (json->string_allocator != nullptr && json->string_allocator != xjson_malloc_string))
+    {
+        xjson_string_view(json, nullptr, &str, &len);
+        if(is_reading(json) && !json->error) val = std::string_view(str, len);
+        return;
+    }
+
+    char* (*string_allocator)(const char* str, size_t size, void* mem_ctx) = json->string_allocator;
+    void* mem_ctx = json->mem_ctx;
+    bool escaped = false;
+    json->string_allocator = reject_escaped;
+    json->mem_ctx = &escaped;
+
+    xjson_string_view(json, nullptr, &str, &len);
+
+    json->string_allocator = string_allocator;
+    json->mem_ctx = mem_ctx;
+    if(escaped)
+    {
+        xjson_error(json, "Strings with escape sequences need an arena to be read into a std::string_view.");
+        return;
+    }
+    if(!json->error) val = std::string_view(str, len);
+}
+
+/* The string allocator for std::string, mem_ctx is the string */
+inline char* string_into(const char* str, size_t size, void* mem_ctx)
+{
+    std::string* target = static_cast<std::string*>(mem_ctx);
+    target->assign(str, size);
+    return &(*target)[0];
+}
+
+/* When reading, the string is copied from the json input into val directly. Escape sequences are decoded in val's
+   buffer, so the string allocator isn't used. */
+inline void value(xjson* json, std::string& val)
+{
+    if(!is_reading(json))
+    {
+        const char* str = val.c_str();
+        size_t len = val.size();
+        xjson_string_view(json, nullptr, &str, &len);
+        return;
+    }
+
+    char* (*string_allocator)(const char* str, size_t size, void* mem_ctx) = json->string_allocator;
+    void* mem_ctx = json->mem_ctx;
+    json->string_allocator = string_into;
+    json->mem_ctx = &val;
+
+    const char* str = nullptr;
+    size_t len = 0;
+    xjson_string_view(json, nullptr, &str, &len);
+
+    json->string_allocator = string_allocator;
+    json->mem_ctx = mem_ctx;
+    if(json->error || str == nullptr) return;
+
+    // Escaped strings have been decoded into val already
+    if(str == val.data())
+        val.resize(len);
+    else
+        val.assign(str, len);
+}
+
+template<class T, class Allocator>
+void value(xjson* json, std::vector<T, Allocator>& vals);
+template<class T, size_t N>
+void value(xjson* json, std::array<T, N>& vals);
+
+/* When reading, the vector is replaced by the elements of the array */
+template<class T, class Allocator>
+void value(xjson* json, std::vector<T, Allocator>& vals)
+{
+    if(!is_reading(json))
+    {
+        if constexpr(is_number<T>)
+        {
+            size_t count = vals.size();
+            number_array(json, vals.data(), count, &count);
+        }
+        else
+        {
+            xjson_array_begin(json, nullptr);
+            for(size_t i=0; i<vals.size() && !json->error; i++)
+            {
+                if constexpr(std::is_same_v<T, bool>)
+                {
+                    // std::vector<bool> has no references to its elements
+                    bool val = vals[i];
+                    value(json, val);
+                }
+                else
+                {
+                    value(json, vals[i]);
+                }
+            }
+            xjson_array_end(json);
+        }
+        return;
+    }
+
+    if constexpr(is_number<T>)
+    {
+        // Sized up front so that a single xjson_*_array call reads the whole array
+        vals.resize(xjson_peek_array_size(json));
+        size_t count = 0;
+        number_array(json, vals.data(), vals.size(), &count);
+        vals.resize(count);
+        return;
+    }
+
+    xjson_array_begin(json, nullptr);
+    if(!json->error) vals.clear();
+    for(int i=0; !xjson_array_reached_end(json, i, 0); i++)
+    {
+        T val{};
+        value(json, val);
+        vals.push_back(std::move(val));
+    }
+    xjson_array_end(json);
+}
+
+/* When reading, an array with more than N elements is an error. Elements after the last one read are left as they are */
+template<class T, size_t N>
+void value(xjson* json, std::array<T, N>& vals)
+{
+    if constexpr(is_number<T>)
+    {
+        number_array(json, vals.data(), N, nullptr);
+        return;
+    }
+
+    xjson_array_begin(json, nullptr);
+    for(int i=0; !xjson_array_reached_end(json, i, (int)N); i++)
+    {
+        if((size_t)i >= N)
+        {
+            xjson_error(json, "Array has more values than fit.");
+            break;
+        }
+        value(json, vals[i]);
+    }
+    xjson_array_end(json);
+}
+
+//----------------------------------------------------------------------------------
+// Values with key
+//----------------------------------------------------------------------------------
+
+/* Reads/writes the value of key. When reading, a missing key leaves val as it is */
+template<class T>
+void value(xjson* json, const key& k, T& val)
+{
+    if(xjson_key_hashed(json, k.str, k.len, k.hash)) value(json, val);
+}
+
+/* An empty optional isn't written. When reading, a missing key resets it */
+template<class T>
+void value(xjson* json, const key& k, std::optional<T>& val)
+{
+    if(!is_reading(json))
+    {
+        if(val.has_value()) value(json, k, *val);
+        return;
+    }
+
+    if(!xjson_key_hashed(json, k.str, k.len, k.hash))
+    {
+        if(!json->error) val.reset();
+        return;
+    }
+    if(!val.has_value()) val.emplace();
+    value(json, *val);
+}
+
+} // namespace xj
+
+#endif // XJSON_HPP